@@ -0,0 +1,266 @@
+#include "acpi.h"
+
+/**
+ * See ACPI Specification 6.4
+ *  [5.2.5.3 Root System Description Pointer (RSDP) Structure]
+ */
+struct acpi_rsdp
+{
+    char signature[8];
+    u8 checksum;
+    char oem_id[6];
+    u8 revision;
+    u32 rsdt_address;
+    /* Since revision 2 */
+    u32 length;
+    u64 xsdt_address;
+    u8 extended_checksum;
+    u8 reserved[3];
+} __attribute__((packed));
+
+/**
+ * See ACPI Specification 6.4
+ *  [5.2.6 System Description Table Header]
+ */
+struct acpi_sdt_header
+{
+    char signature[4];
+    u32 length;
+    u8 revision;
+    u8 checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    u32 oem_revision;
+    u32 creator_id;
+    u32 creator_revision;
+} __attribute__((packed));
+
+/**
+ * SRAT header is followed by a list of
+ * affinity structures, each starting with
+ * its type and length.
+ */
+struct acpi_srat
+{
+    struct acpi_sdt_header header;
+    u32 reserved1;
+    u64 reserved2;
+} __attribute__((packed));
+
+struct acpi_srat_entry
+{
+    u8 type;
+    u8 length;
+} __attribute__((packed));
+
+#define SRAT_LOCAL_APIC 0
+#define SRAT_MEMORY     1
+#define SRAT_X2APIC     2
+
+#define SRAT_ENABLED (1 << 0)
+
+struct acpi_srat_local_apic
+{
+    struct acpi_srat_entry entry;
+    u8 domain_low;
+    u8 apic_id;
+    u32 flags;
+    u8 sapic_eid;
+    u8 domain_high[3];
+    u32 clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_memory
+{
+    struct acpi_srat_entry entry;
+    u32 domain;
+    u16 reserved1;
+    u64 base;
+    u64 length;
+    u32 reserved2;
+    u32 flags;
+    u64 reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic
+{
+    struct acpi_srat_entry entry;
+    u16 reserved1;
+    u32 domain;
+    u32 x2apic_id;
+    u32 flags;
+    u32 clock_domain;
+    u32 reserved2;
+} __attribute__((packed));
+
+static unsigned long limit;
+
+/**
+ * Is [ptr, ptr + size) identity mapped?
+ */
+static int reachable(unsigned long ptr, unsigned long size)
+{
+    return ptr && ptr < limit && size <= limit - ptr;
+}
+
+static int checksum(const void *ptr, unsigned long size)
+{
+    const u8 *p = ptr;
+    u8 sum = 0;
+    while (size--)
+        sum += *p++;
+    return sum;
+}
+
+static int same_signature(const char *a, const char *b, int n)
+{
+    while (n--)
+    {
+        if (*a++ != *b++)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Search [start, end) on 16 bytes boundaries.
+ */
+static struct acpi_rsdp *scan_rsdp(unsigned long start, unsigned long end)
+{
+    for (start &= ~15UL; start + sizeof(struct acpi_rsdp) <= end; start += 16)
+    {
+        struct acpi_rsdp *rsdp = (struct acpi_rsdp *)start;
+        /* The first 20 bytes are covered by the checksum */
+        if (same_signature(rsdp->signature, "RSD PTR ", 8) && !checksum(rsdp, 20))
+            return rsdp;
+    }
+    return (void*)0;
+}
+
+/**
+ * See ACPI Specification 6.4
+ *  [5.2.5.1 Finding the RSDP on IA-PC Systems]
+ *  -The first 1 KB of the Extended BIOS Data Area (EBDA),
+ *   whose segment is stored at 0x40E.
+ *  -The BIOS read-only memory space between 0E0000h
+ *   and 0FFFFFh.
+ */
+static struct acpi_rsdp *find_rsdp()
+{
+    const unsigned long ebda = (unsigned long)*(u16 *)0x40E << 4;
+    struct acpi_rsdp *rsdp = (void*)0;
+    if (ebda)
+        rsdp = scan_rsdp(ebda, ebda + 1024);
+    if (!rsdp)
+        rsdp = scan_rsdp(0xE0000, 0x100000);
+    return rsdp;
+}
+
+static struct acpi_sdt_header *valid_table(unsigned long address, const char *signature)
+{
+    struct acpi_sdt_header *h = (struct acpi_sdt_header *)address;
+    if (!reachable(address, sizeof(*h)) || !reachable(address, h->length))
+        return (void*)0;
+    if (!same_signature(h->signature, signature, 4) || checksum(h, h->length))
+        return (void*)0;
+    return h;
+}
+
+/**
+ * Find a table listed in the XSDT (64 bit entries)
+ * or in the RSDT (32 bit entries).
+ */
+static struct acpi_sdt_header *find_table(struct acpi_rsdp *rsdp, const char *signature)
+{
+    struct acpi_sdt_header *root;
+    unsigned long i, n;
+
+    if (rsdp->revision >= 2 && (root = valid_table(rsdp->xsdt_address, "XSDT")))
+    {
+        /* Entries are 64 bit but only 4 bytes aligned, read them in halves */
+        u32 *entries = (u32 *)(root + 1);
+        n = (root->length - sizeof(*root)) / sizeof(u64);
+        for (i = 0; i != n; ++i)
+        {
+            const unsigned long address = entries[2*i] | (unsigned long)entries[2*i+1] << 32;
+            if (valid_table(address, signature))
+                return (struct acpi_sdt_header *)address;
+        }
+        return (void*)0;
+    }
+    if ((root = valid_table(rsdp->rsdt_address, "RSDT")))
+    {
+        u32 *entries = (u32 *)(root + 1);
+        n = (root->length - sizeof(*root)) / sizeof(*entries);
+        for (i = 0; i != n; ++i)
+        {
+            if (valid_table(entries[i], signature))
+                return (struct acpi_sdt_header *)(unsigned long)entries[i];
+        }
+    }
+    return (void*)0;
+}
+
+static void add_cpu(struct acpi_srat_info *info, unsigned int apic_id, unsigned int domain)
+{
+    if (info->cpu_count == ACPI_SRAT_MAX_CPUS)
+        return;
+    info->cpus[info->cpu_count].apic_id = apic_id;
+    info->cpus[info->cpu_count].domain = domain;
+    ++info->cpu_count;
+}
+
+int acpi_read_srat(struct acpi_srat_info *info, unsigned long mapped_limit)
+{
+    struct acpi_rsdp *rsdp;
+    struct acpi_sdt_header *srat;
+    unsigned long ptr, end;
+
+    info->memory_count = 0;
+    info->cpu_count = 0;
+    limit = mapped_limit;
+
+    rsdp = find_rsdp();
+    if (!rsdp)
+        return 1;
+    srat = find_table(rsdp, "SRAT");
+    if (!srat)
+        return 1;
+
+    ptr = (unsigned long)srat + sizeof(struct acpi_srat);
+    end = (unsigned long)srat + srat->length;
+    while (ptr + sizeof(struct acpi_srat_entry) <= end)
+    {
+        struct acpi_srat_entry *e = (struct acpi_srat_entry *)ptr;
+        if (e->length < sizeof(*e) || ptr + e->length > end)
+            break;
+        if (e->type == SRAT_MEMORY && e->length >= sizeof(struct acpi_srat_memory))
+        {
+            struct acpi_srat_memory *m = (struct acpi_srat_memory *)e;
+            if ((m->flags & SRAT_ENABLED) && m->length && info->memory_count != ACPI_SRAT_MAX_MEMORY)
+            {
+                info->memory[info->memory_count].start = m->base;
+                info->memory[info->memory_count].end = m->base + m->length;
+                info->memory[info->memory_count].domain = m->domain;
+                ++info->memory_count;
+            }
+        }
+        else if (e->type == SRAT_LOCAL_APIC && e->length >= sizeof(struct acpi_srat_local_apic))
+        {
+            struct acpi_srat_local_apic *c = (struct acpi_srat_local_apic *)e;
+            if (c->flags & SRAT_ENABLED)
+            {
+                add_cpu(info, c->apic_id, c->domain_low
+                    | c->domain_high[0] << 8 | c->domain_high[1] << 16 | c->domain_high[2] << 24);
+            }
+        }
+        else if (e->type == SRAT_X2APIC && e->length >= sizeof(struct acpi_srat_x2apic))
+        {
+            struct acpi_srat_x2apic *c = (struct acpi_srat_x2apic *)e;
+            if (c->flags & SRAT_ENABLED)
+                add_cpu(info, c->x2apic_id, c->domain);
+        }
+        ptr += e->length;
+    }
+    return info->memory_count ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+/**
+ * Minimal reader of the ACPI tables, used to find
+ * the NUMA topology in the System Resource Affinity
+ * Table (SRAT).
+ *
+ * See:
+ *  ACPI Specification 6.4
+ *  [5.2.5 Root System Description Pointer (RSDP)]
+ *  [5.2.16 System Resource Affinity Table (SRAT)]
+ */
+
+#ifndef ACPI
+#define ACPI
+
+#include "types.h"
+
+#define ACPI_SRAT_MAX_MEMORY 32
+#define ACPI_SRAT_MAX_CPUS 64
+
+struct acpi_memory_affinity
+{
+    unsigned long start;
+    unsigned long end;
+    unsigned int domain;
+};
+
+struct acpi_cpu_affinity
+{
+    unsigned int apic_id;
+    unsigned int domain;
+};
+
+/**
+ * Enabled entries of the SRAT
+ */
+struct acpi_srat_info
+{
+    int memory_count;
+    struct acpi_memory_affinity memory[ACPI_SRAT_MAX_MEMORY];
+    int cpu_count;
+    struct acpi_cpu_affinity cpus[ACPI_SRAT_MAX_CPUS];
+};
+
+/**
+ * Look for the RSDP in the BIOS areas, then for the
+ * SRAT through the XSDT or the RSDT, and fill info.
+ * Tables at or above mapped_limit are not reachable
+ * and are ignored.
+ *
+ * Return 0 on success, nonzero if no valid SRAT
+ * was found.
+ */
+int acpi_read_srat(struct acpi_srat_info *info, unsigned long mapped_limit);
+
+#endif
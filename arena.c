@@ -0,0 +1,94 @@
+#include "arena.h"
+#include "memory.h"
+
+void arena_init(struct arena *a)
+{
+    a->index = (void*)0;
+    a->next = (void*)0;
+    a->left = 0;
+    a->pages = 0;
+}
+
+/**
+ * Record a page in the index, adding an
+ * index page when the current one is full.
+ */
+static int arena_track(struct arena *a, void *page)
+{
+    if (!a->index || a->index->count == ARENA_INDEX_ENTRIES)
+    {
+        struct arena_index *index = kalloc_page();
+        if (!index)
+            return 1;
+        index->next = a->index;
+        index->count = 0;
+        a->index = index;
+        ++a->pages;
+    }
+    a->index->pages[a->index->count++] = page;
+    ++a->pages;
+    return 0;
+}
+
+static void *arena_take_page(struct arena *a, int zeroed)
+{
+    void *page = zeroed ? kalloc_page_zeroed() : kalloc_page();
+    if (!page)
+        return (void*)0;
+    if (arena_track(a, page))
+    {
+        kfree_page(page);
+        return (void*)0;
+    }
+    return page;
+}
+
+void *arena_alloc(struct arena *a, unsigned long size, unsigned long align)
+{
+    unsigned long pad;
+    void *ptr;
+
+    if (!a || !size || size > ARENA_PAGE_SIZE || !align || (align & (align - 1)))
+        return (void*)0;
+
+    pad = -(unsigned long)a->next & (align - 1);
+    if (pad + size > a->left)
+    {
+        /* The rest of the current page is wasted */
+        a->next = arena_take_page(a, 0);
+        if (!a->next)
+        {
+            a->left = 0;
+            return (void*)0;
+        }
+        a->left = ARENA_PAGE_SIZE;
+        pad = 0;
+    }
+    ptr = a->next + pad;
+    a->next += pad + size;
+    a->left -= pad + size;
+    return ptr;
+}
+
+void *arena_alloc_page(struct arena *a)
+{
+    if (!a)
+        return (void*)0;
+    return arena_take_page(a, 1);
+}
+
+void arena_destroy(struct arena *a)
+{
+    while (a->index)
+    {
+        struct arena_index *index = a->index;
+        unsigned long i;
+        for (i = 0; i != index->count; ++i)
+        {
+            kfree_page(index->pages[i]);
+        }
+        a->index = index->next;
+        kfree_page(index);
+    }
+    arena_init(a);
+}
@@ -0,0 +1,72 @@
+/**
+ * Region allocator for memory sharing a lifetime,
+ * like everything owned by a virtual machine.
+ *
+ * Pages are taken with kalloc_page and objects are
+ * carved from them by bumping a pointer; objects are
+ * never freed one by one. arena_destroy gives back
+ * every page at once, in time proportional to the
+ * number of pages and not of objects.
+ *
+ * Pages are recorded in index pages, so that whole
+ * page allocations (e.g. VMX regions, which must be
+ * page aligned) keep no header.
+ */
+
+#ifndef ARENA
+#define ARENA
+
+#define ARENA_PAGE_SIZE 4096UL
+
+/**
+ * Index of the pages owned by an arena,
+ * itself one page.
+ */
+#define ARENA_INDEX_ENTRIES ((ARENA_PAGE_SIZE - 2 * sizeof(void *)) / sizeof(void *))
+struct arena_index
+{
+    struct arena_index *next;
+    unsigned long count;
+    void *pages[ARENA_INDEX_ENTRIES];
+};
+
+struct arena
+{
+    /* Most recent index page, the only one not full */
+    struct arena_index *index;
+    /* Free space of the current bump page */
+    char *next;
+    unsigned long left;
+    /* Number of pages held, index pages included */
+    unsigned long pages;
+};
+
+/**
+ * Initialise an empty arena, no memory is
+ * taken until the first allocation.
+ */
+void arena_init(struct arena *a);
+
+/**
+ * Allocate size bytes aligned to align (a power of
+ * two), at most ARENA_PAGE_SIZE bytes.
+ * The memory is not cleared.
+ *
+ * Return a null pointer if no memory is available.
+ */
+void *arena_alloc(struct arena *a, unsigned long size, unsigned long align);
+
+/**
+ * Allocate a whole page filled with zeroes.
+ *
+ * Return a null pointer if no memory is available.
+ */
+void *arena_alloc_page(struct arena *a);
+
+/**
+ * Free all the memory of the arena, which is
+ * left empty and can be used again.
+ */
+void arena_destroy(struct arena *a);
+
+#endif
@@ -0,0 +1,402 @@
+/**
+ * Microbenchmarks of the kernel allocators built
+ * as a normal Linux program, see "make bench".
+ *
+ * The page allocator runs over a buffer obtained
+ * from the C library and the functions of memory.h
+ * used by slab.c, heap.c and arena.c are provided
+ * here on top of it, so no kernel code is needed.
+ *
+ * Usage: bench [operations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../memory.h"
+#include "../buddy.h"
+#include "../slab.h"
+#include "../heap.h"
+#include "../arena.h"
+#include "../modules/C-memory-manager/memory_manager.h"
+
+/**
+ * Memory given to the page allocator
+ */
+#define ARENA_ORDER 16
+#define MEMORY_BYTES (BUDDY_PAGE_SIZE << ARENA_ORDER)
+
+/**
+ * Memory given to mm_malloc
+ */
+#define MM_BYTES (16UL << 20)
+
+/**
+ * Live objects kept by the random patterns
+ */
+#define LIVE_OBJECTS 4096
+
+static struct buddy_allocator pa;
+static unsigned char frames[1UL << ARENA_ORDER];
+static unsigned long ops = 1000000;
+
+/**
+ * Interface of memory.h over the hosted page allocator
+ */
+void *kalloc_pages(int order)
+{
+    return buddy_alloc(&pa, order);
+}
+
+void kfree_pages(void *ptr, int order)
+{
+    if (buddy_free(&pa, ptr, order))
+    {
+        fprintf(stderr, "kfree_pages: invalid free of %p\n", ptr);
+        exit(1);
+    }
+}
+
+void *kalloc_page()
+{
+    return kalloc_pages(0);
+}
+
+void *kalloc_page_zeroed()
+{
+    void *page = kalloc_page();
+    if (page)
+        memset(page, 0, BUDDY_PAGE_SIZE);
+    return page;
+}
+
+void kfree_page(void *page)
+{
+    kfree_pages(page, 0);
+}
+
+static void reset_page_allocator()
+{
+    static char *memory;
+    if (!memory)
+    {
+        memory = aligned_alloc(MEMORY_BYTES, MEMORY_BYTES);
+        if (!memory)
+        {
+            perror("aligned_alloc");
+            exit(1);
+        }
+        /* Fault the pages in, out of the measurements */
+        memset(memory, 0, MEMORY_BYTES);
+    }
+    if (buddy_init(&pa, memory, 1UL << ARENA_ORDER, frames)
+        || buddy_add_region(&pa, memory, memory + MEMORY_BYTES))
+    {
+        fprintf(stderr, "buddy_init failed\n");
+        exit(1);
+    }
+}
+
+/**
+ * Deterministic pseudo random numbers (xorshift64),
+ * the same sequence on every run.
+ */
+static unsigned long rng_state = 88172645463325252UL;
+static unsigned long rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long cycles()
+{
+    return __builtin_ia32_rdtsc();
+}
+
+static void report_throughput(const char *name, unsigned long n, double seconds)
+{
+    printf("%-36s %10.1f ns/op %10.2f Mop/s\n", name, seconds * 1e9 / n, n / seconds * 1e-6);
+}
+
+static int compare_ul(const void *a, const void *b)
+{
+    const unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Sort the samples and print the percentiles,
+ * in TSC cycles.
+ */
+static void report_latency(const char *name, unsigned long *samples, unsigned long n)
+{
+    qsort(samples, n, sizeof(*samples), compare_ul);
+    printf("%-36s p50 %6lu p90 %6lu p99 %6lu p99.9 %7lu max %8lu cycles\n", name,
+        samples[n / 2], samples[n * 9 / 10], samples[n * 99 / 100],
+        samples[n * 999 / 1000], samples[n - 1]);
+}
+
+/**
+ * Allocate and free the same page, always
+ * served from the head of the order 0 list.
+ */
+static void bench_pages_lifo()
+{
+    unsigned long i;
+    double t;
+
+    reset_page_allocator();
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        void *p = kalloc_pages(0);
+        kfree_pages(p, 0);
+    }
+    report_throughput("pages: alloc/free LIFO", ops, now() - t);
+}
+
+/**
+ * Allocate batches of pages, then free them in
+ * reverse order: every free merges buddies.
+ */
+static void bench_pages_batch()
+{
+    static void *pages[LIVE_OBJECTS];
+    unsigned long i, done = 0;
+    double t;
+
+    reset_page_allocator();
+    t = now();
+    while (done < ops)
+    {
+        for (i = 0; i != LIVE_OBJECTS; ++i)
+            pages[i] = kalloc_pages(0);
+        while (i)
+            kfree_pages(pages[--i], 0);
+        done += LIVE_OBJECTS;
+    }
+    report_throughput("pages: batch alloc then free", done, now() - t);
+}
+
+/**
+ * Replace random live blocks of random orders,
+ * measuring each allocation. Print the free list
+ * histogram at the end to show fragmentation.
+ */
+static void bench_pages_random()
+{
+    static void *blocks[LIVE_OBJECTS];
+    static int orders[LIVE_OBJECTS];
+    unsigned long *samples = malloc(ops * sizeof(*samples));
+    unsigned long i, failures = 0;
+    double t;
+    int o;
+
+    reset_page_allocator();
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+    {
+        orders[i] = rng() % 4;
+        blocks[i] = kalloc_pages(orders[i]);
+    }
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        const unsigned long k = rng() % LIVE_OBJECTS;
+        unsigned long c;
+        if (blocks[k])
+            kfree_pages(blocks[k], orders[k]);
+        orders[k] = rng() % 4;
+        c = cycles();
+        blocks[k] = kalloc_pages(orders[k]);
+        samples[i] = cycles() - c;
+        failures += !blocks[k];
+    }
+    report_throughput("pages: random orders 0-3", ops, now() - t);
+    report_latency("pages: random alloc latency", samples, ops);
+    printf("  used %lu of %lu frames, %lu failures, largest free order %d\n",
+        pa.used_frames, pa.managed_frames, failures, buddy_largest_free_order(&pa));
+    printf("  free blocks per order:");
+    for (o = 0; o != BUDDY_ORDERS; ++o)
+        printf(" %lu", pa.free_count[o]);
+    printf("\n");
+    free(samples);
+}
+
+static void bench_slab()
+{
+    static void *objects[LIVE_OBJECTS];
+    struct kmem_cache *cache;
+    unsigned long *samples = malloc(ops * sizeof(*samples));
+    unsigned long i;
+    double t;
+
+    reset_page_allocator();
+    cache = kmem_cache_create("bench-128", 128, 0, (void*)0);
+    if (!cache)
+    {
+        fprintf(stderr, "kmem_cache_create failed\n");
+        exit(1);
+    }
+
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        void *p = kmem_cache_alloc(cache);
+        kmem_cache_free(cache, p);
+    }
+    report_throughput("slab: alloc/free LIFO", ops, now() - t);
+
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+        objects[i] = kmem_cache_alloc(cache);
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        const unsigned long k = rng() % LIVE_OBJECTS;
+        unsigned long c;
+        kmem_cache_free(cache, objects[k]);
+        c = cycles();
+        objects[k] = kmem_cache_alloc(cache);
+        samples[i] = cycles() - c;
+    }
+    report_throughput("slab: random replacement", ops, now() - t);
+    report_latency("slab: random alloc latency", samples, ops);
+    printf("  %lu objects in %lu slabs\n", cache->active_objects, cache->slab_count);
+
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+        kmem_cache_free(cache, objects[i]);
+    kmem_cache_destroy(cache);
+    free(samples);
+}
+
+/**
+ * Sizes of the mixed workloads: mostly small,
+ * sometimes up to a few pages.
+ */
+static unsigned long random_size()
+{
+    const unsigned long r = rng();
+    if (r % 16)
+        return 16 + r % 512;
+    return 1024 + r % 16384;
+}
+
+static void bench_heap()
+{
+    static void *objects[LIVE_OBJECTS];
+    struct heap h;
+    unsigned long *samples = malloc(ops * sizeof(*samples));
+    unsigned long i, failures = 0;
+    double t;
+
+    reset_page_allocator();
+    heap_init(&h);
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+        objects[i] = heap_alloc(&h, random_size());
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        const unsigned long k = rng() % LIVE_OBJECTS;
+        unsigned long c;
+        if (objects[k])
+            heap_free(&h, objects[k]);
+        c = cycles();
+        objects[k] = heap_alloc(&h, random_size());
+        samples[i] = cycles() - c;
+        failures += !objects[k];
+    }
+    report_throughput("heap: random mixed sizes", ops, now() - t);
+    report_latency("heap: random alloc latency", samples, ops);
+    printf("  used %lu bytes in %lu bytes of chunks (%.1f%%), peak %lu, largest free %lu, %lu failures\n",
+        h.used_bytes, h.chunk_bytes, 100.0 * h.used_bytes / h.chunk_bytes,
+        h.peak_chunk_bytes, heap_largest_free(&h), failures);
+
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+    {
+        if (objects[i])
+            heap_free(&h, objects[i]);
+    }
+    free(samples);
+}
+
+static void bench_mm()
+{
+    static void *objects[LIVE_OBJECTS];
+    void *region = malloc(MM_BYTES);
+    unsigned long *samples = malloc(ops * sizeof(*samples));
+    unsigned long i, failures = 0;
+    double t;
+
+    if (!region || mm_init_memory_manager(region, MM_BYTES))
+    {
+        fprintf(stderr, "mm_init_memory_manager failed\n");
+        exit(1);
+    }
+    for (i = 0; i != LIVE_OBJECTS; ++i)
+        objects[i] = mm_malloc(random_size());
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        const unsigned long k = rng() % LIVE_OBJECTS;
+        unsigned long c;
+        if (objects[k])
+            mm_free(objects[k]);
+        c = cycles();
+        objects[k] = mm_malloc(random_size());
+        samples[i] = cycles() - c;
+        failures += !objects[k];
+    }
+    report_throughput("mm_malloc: random mixed sizes", ops, now() - t);
+    report_latency("mm_malloc: random alloc latency", samples, ops);
+    printf("  %lu failures in %lu bytes\n", failures, MM_BYTES);
+    free(samples);
+    free(region);
+}
+
+static void bench_arena()
+{
+    struct arena a;
+    unsigned long i;
+    double t;
+
+    reset_page_allocator();
+    arena_init(&a);
+    t = now();
+    for (i = 0; i != ops; ++i)
+    {
+        if (!arena_alloc(&a, random_size() % 256 + 1, 16))
+        {
+            arena_destroy(&a);
+        }
+    }
+    arena_destroy(&a);
+    report_throughput("arena: bump allocation", ops, now() - t);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        ops = strtoul(argv[1], (void*)0, 0);
+    if (ops < LIVE_OBJECTS)
+        ops = LIVE_OBJECTS;
+
+    printf("%lu operations, %lu MB of pages\n", ops, MEMORY_BYTES >> 20);
+    bench_pages_lifo();
+    bench_pages_batch();
+    bench_pages_random();
+    bench_slab();
+    bench_heap();
+    bench_mm();
+    bench_arena();
+    return 0;
+}
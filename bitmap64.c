@@ -0,0 +1,130 @@
+#include "bitmap64.h"
+
+#define FULL_WORD (~0UL)
+
+static inline unsigned long word_count(struct bitmap64 *bm)
+{
+    return BITMAP64_WORDS(bm->bits);
+}
+
+/**
+ * Keep the summary bit of a word in sync with it
+ */
+static inline void update_summary(struct bitmap64 *bm, unsigned long w)
+{
+    if (!bm->summary)
+        return;
+    if (bm->words[w] == FULL_WORD)
+        bm->summary[w / BITMAP64_WORD_BITS] |= 1UL << (w % BITMAP64_WORD_BITS);
+    else
+        bm->summary[w / BITMAP64_WORD_BITS] &= ~(1UL << (w % BITMAP64_WORD_BITS));
+}
+
+int bitmap64_init(struct bitmap64 *bm, unsigned long *words, unsigned long *summary, unsigned long bits)
+{
+    unsigned long i, n;
+
+    if (!bm || !words || !bits)
+        return 1;
+
+    bm->words = words;
+    bm->summary = summary;
+    bm->bits = bits;
+    bm->hint = 0;
+    n = word_count(bm);
+    for (i = 0; i != n; ++i)
+        words[i] = 0;
+    /* Bits past the end are never handed out */
+    if (bits % BITMAP64_WORD_BITS)
+        words[n-1] = FULL_WORD << (bits % BITMAP64_WORD_BITS);
+    if (summary)
+    {
+        const unsigned long s = BITMAP64_WORDS(n);
+        for (i = 0; i != s; ++i)
+            summary[i] = 0;
+        /* Same for words past the end */
+        if (n % BITMAP64_WORD_BITS)
+            summary[s-1] = FULL_WORD << (n % BITMAP64_WORD_BITS);
+        update_summary(bm, n-1);
+    }
+    return 0;
+}
+
+/**
+ * Return the index of the first word with a clear
+ * bit at or after "from", or word_count if none.
+ */
+static unsigned long find_word(struct bitmap64 *bm, unsigned long from)
+{
+    const unsigned long n = word_count(bm);
+    unsigned long w = from;
+
+    if (!bm->summary)
+    {
+        while (w < n && bm->words[w] == FULL_WORD)
+            ++w;
+        return w;
+    }
+
+    /* Use the summary to skip 64 full words at a time */
+    while (w < n)
+    {
+        const unsigned long s = w / BITMAP64_WORD_BITS;
+        /* Ignore words before w in the first summary word */
+        unsigned long free = ~bm->summary[s] & (FULL_WORD << (w % BITMAP64_WORD_BITS));
+        if (free)
+            return s * BITMAP64_WORD_BITS + bitmap64_lowest(free);
+        w = (s + 1) * BITMAP64_WORD_BITS;
+    }
+    return n;
+}
+
+long bitmap64_alloc(struct bitmap64 *bm)
+{
+    const unsigned long n = word_count(bm);
+    unsigned long w, bit;
+
+    /* Search from the hint, then wrap around */
+    w = find_word(bm, bm->hint);
+    if (w >= n)
+    {
+        w = find_word(bm, 0);
+        if (w >= bm->hint || w >= n)
+            return -1;
+    }
+
+    bit = bitmap64_lowest(~bm->words[w]);
+    bm->words[w] |= 1UL << bit;
+    update_summary(bm, w);
+    bm->hint = w;
+
+    return w * BITMAP64_WORD_BITS + bit;
+}
+
+void bitmap64_set(struct bitmap64 *bm, unsigned long bit)
+{
+    const unsigned long w = bit / BITMAP64_WORD_BITS;
+    if (bit >= bm->bits)
+        return;
+    bm->words[w] |= 1UL << (bit % BITMAP64_WORD_BITS);
+    update_summary(bm, w);
+}
+
+void bitmap64_clear(struct bitmap64 *bm, unsigned long bit)
+{
+    const unsigned long w = bit / BITMAP64_WORD_BITS;
+    if (bit >= bm->bits)
+        return;
+    bm->words[w] &= ~(1UL << (bit % BITMAP64_WORD_BITS));
+    update_summary(bm, w);
+    /* Keep allocations dense at low indices */
+    if (w < bm->hint)
+        bm->hint = w;
+}
+
+int bitmap64_test(struct bitmap64 *bm, unsigned long bit)
+{
+    if (bit >= bm->bits)
+        return 0;
+    return (bm->words[bit / BITMAP64_WORD_BITS] >> (bit % BITMAP64_WORD_BITS)) & 1;
+}
@@ -0,0 +1,92 @@
+/**
+ * Bitmap of resources scanned one 64 bit word
+ * at a time.
+ *
+ * A set bit means "in use". The search for a clear
+ * bit starts from a hint (the word where the last
+ * allocation succeeded) and uses TZCNT/BSF on the
+ * complement of each word, so full words cost one
+ * comparison and partial words one instruction.
+ *
+ * An optional summary level holds one bit for each
+ * word of the bitmap, set when the word is full: a
+ * single summary word skips 4096 used entries.
+ */
+
+#ifndef BITMAP64
+#define BITMAP64
+
+#define BITMAP64_WORD_BITS 64
+
+/**
+ * Number of unsigned long needed to hold n bits
+ */
+#define BITMAP64_WORDS(n) (((n) + BITMAP64_WORD_BITS - 1) / BITMAP64_WORD_BITS)
+
+/**
+ * Number of unsigned long needed for the summary
+ * of a bitmap of n bits
+ */
+#define BITMAP64_SUMMARY_WORDS(n) BITMAP64_WORDS(BITMAP64_WORDS(n))
+
+struct bitmap64
+{
+    unsigned long *words;
+    /* One bit for each full word, may be null */
+    unsigned long *summary;
+    unsigned long bits;
+    /* Word where the next search starts */
+    unsigned long hint;
+};
+
+/**
+ * Initialise a bitmap of "bits" clear bits.
+ * "words" must hold BITMAP64_WORDS(bits) elements,
+ * "summary" may be a null pointer or must hold
+ * BITMAP64_SUMMARY_WORDS(bits) elements.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int bitmap64_init(struct bitmap64 *bm, unsigned long *words, unsigned long *summary, unsigned long bits);
+
+/**
+ * Find a clear bit, set it and return its index.
+ *
+ * Return -1 if every bit is set.
+ */
+long bitmap64_alloc(struct bitmap64 *bm);
+
+/**
+ * Set the given bit.
+ */
+void bitmap64_set(struct bitmap64 *bm, unsigned long bit);
+
+/**
+ * Clear the given bit.
+ */
+void bitmap64_clear(struct bitmap64 *bm, unsigned long bit);
+
+/**
+ * Return nonzero if the given bit is set.
+ */
+int bitmap64_test(struct bitmap64 *bm, unsigned long bit);
+
+/**
+ * Index of the lowest set bit of a nonzero word.
+ * Compiled to TZCNT or BSF.
+ */
+static inline unsigned long bitmap64_lowest(unsigned long word)
+{
+    return __builtin_ctzl(word);
+}
+
+/**
+ * Index of the highest set bit of a nonzero word.
+ * Compiled to LZCNT or BSR.
+ */
+static inline unsigned long bitmap64_highest(unsigned long word)
+{
+    return BITMAP64_WORD_BITS - 1 - __builtin_clzl(word);
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "buddy.h"
+#include "bitmap64.h"
+
+/**
+ * Encoding of the per-frame metadata byte:
+ *  -RESERVED:  frame not managed by the allocator
+ *  -TAIL:      frame inside a block, but not its first one
+ *  -FREE:      first frame of a free block, low bits hold the order
+ *  -USED:      first frame of an allocated block, low bits hold the order
+ */
+#define BUDDY_FRAME_RESERVED    0xff
+#define BUDDY_FRAME_TAIL        0x00
+#define BUDDY_FRAME_FREE        0x40
+#define BUDDY_FRAME_USED        0x80
+#define BUDDY_FRAME_ORDER_MASK  0x1f
+
+static inline unsigned long ptr_to_pfn(void *ptr)
+{
+    return (unsigned long)ptr >> BUDDY_PAGE_SHIFT;
+}
+
+static inline void *pfn_to_ptr(unsigned long pfn)
+{
+    return (void *)(pfn << BUDDY_PAGE_SHIFT);
+}
+
+/**
+ * Is the frame described by the allocator?
+ */
+static inline int pfn_valid(struct buddy_allocator *b, unsigned long pfn)
+{
+    return b->base_pfn <= pfn && pfn - b->base_pfn < b->frame_count;
+}
+
+static inline unsigned char *frame_of(struct buddy_allocator *b, unsigned long pfn)
+{
+    return &b->frames[pfn - b->base_pfn];
+}
+
+static void list_push(struct buddy_allocator *b, unsigned long pfn, int order)
+{
+    struct buddy_block *block = (struct buddy_block *)pfn_to_ptr(pfn);
+
+    block->prev = (void*)0;
+    block->next = b->free_list[order];
+    if (block->next)
+        block->next->prev = block;
+    b->free_list[order] = block;
+    ++b->free_count[order];
+    b->order_mask |= 1UL << order;
+
+    *frame_of(b, pfn) = BUDDY_FRAME_FREE | order;
+}
+
+static void list_remove(struct buddy_allocator *b, unsigned long pfn, int order)
+{
+    struct buddy_block *block = (struct buddy_block *)pfn_to_ptr(pfn);
+
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        b->free_list[order] = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+    if (!--b->free_count[order])
+        b->order_mask &= ~(1UL << order);
+
+    *frame_of(b, pfn) = BUDDY_FRAME_TAIL;
+}
+
+/**
+ * Insert a free block merging it with its buddies
+ * while possible.
+ */
+static void release_block(struct buddy_allocator *b, unsigned long pfn, int order)
+{
+    while (order < BUDDY_MAX_ORDER)
+    {
+        const unsigned long buddy = pfn ^ (1UL << order);
+        if (!pfn_valid(b, buddy) || *frame_of(b, buddy) != (BUDDY_FRAME_FREE | order))
+            break;
+        list_remove(b, buddy, order);
+        /* Merged block starts at the lower of the two */
+        if (buddy < pfn)
+        {
+            *frame_of(b, pfn) = BUDDY_FRAME_TAIL;
+            pfn = buddy;
+        }
+        ++order;
+    }
+    list_push(b, pfn, order);
+}
+
+int buddy_init(struct buddy_allocator *b, void *base, unsigned long frame_count, unsigned char *frames)
+{
+    int i;
+    unsigned long j;
+
+    if (!b || !frames || !frame_count)
+        return 1;
+
+    b->base_pfn = ptr_to_pfn(base);
+    b->frame_count = frame_count;
+    b->frames = frames;
+    for (i = 0; i != BUDDY_ORDERS; ++i)
+    {
+        b->free_list[i] = (void*)0;
+        b->free_count[i] = 0;
+    }
+    b->order_mask = 0;
+    b->managed_frames = 0;
+    b->allocs = 0;
+    b->frees = 0;
+    b->failures = 0;
+    b->used_frames = 0;
+    b->peak_used_frames = 0;
+    for (j = 0; j != frame_count; ++j)
+    {
+        frames[j] = BUDDY_FRAME_RESERVED;
+    }
+    return 0;
+}
+
+int buddy_add_region(struct buddy_allocator *b, void *start, void *end)
+{
+    /* Round start up and end down to frame boundaries */
+    unsigned long pfn = ptr_to_pfn((void *)((unsigned long)start + BUDDY_PAGE_SIZE - 1));
+    unsigned long last = ptr_to_pfn(end);
+    unsigned long i;
+
+    if (!b || last <= pfn)
+        return 1;
+    if (!pfn_valid(b, pfn) || !pfn_valid(b, last - 1))
+        return 1;
+    for (i = pfn; i != last; ++i)
+    {
+        /* Overlap with an already registered region */
+        if (*frame_of(b, i) != BUDDY_FRAME_RESERVED)
+            return 1;
+    }
+
+    b->managed_frames += last - pfn;
+
+    /**
+     * Split the region into the biggest naturally
+     * aligned blocks it contains.
+     */
+    while (pfn != last)
+    {
+        int order = 0;
+        while (order < BUDDY_MAX_ORDER
+            && !(pfn & ((2UL << order) - 1))
+            && pfn + (2UL << order) <= last)
+        {
+            ++order;
+        }
+        for (i = 1; i != (1UL << order); ++i)
+        {
+            *frame_of(b, pfn + i) = BUDDY_FRAME_TAIL;
+        }
+        release_block(b, pfn, order);
+        pfn += 1UL << order;
+    }
+    return 0;
+}
+
+void *buddy_alloc(struct buddy_allocator *b, int order)
+{
+    int current;
+    unsigned long pfn, candidates;
+
+    if (!b || order < 0 || order > BUDDY_MAX_ORDER)
+        return (void*)0;
+
+    /* Find the smallest available block big enough */
+    candidates = b->order_mask & (~0UL << order);
+    if (!candidates)
+    {
+        ++b->failures;
+        return (void*)0;
+    }
+    current = bitmap64_lowest(candidates);
+
+    pfn = ptr_to_pfn(b->free_list[current]);
+    list_remove(b, pfn, current);
+    /* Give back the upper halves not needed */
+    while (current != order)
+    {
+        --current;
+        list_push(b, pfn + (1UL << current), current);
+    }
+    *frame_of(b, pfn) = BUDDY_FRAME_USED | order;
+
+    ++b->allocs;
+    b->used_frames += 1UL << order;
+    if (b->used_frames > b->peak_used_frames)
+        b->peak_used_frames = b->used_frames;
+
+    return pfn_to_ptr(pfn);
+}
+
+int buddy_allocated(struct buddy_allocator *b, void *ptr, int order)
+{
+    const unsigned long pfn = ptr_to_pfn(ptr);
+
+    if (!b || order < 0 || order > BUDDY_MAX_ORDER)
+        return 0;
+    /* Must be the beginning of a block */
+    if ((unsigned long)ptr & (BUDDY_PAGE_SIZE - 1))
+        return 0;
+    if (!pfn_valid(b, pfn))
+        return 0;
+    return *frame_of(b, pfn) == (BUDDY_FRAME_USED | order);
+}
+
+int buddy_free(struct buddy_allocator *b, void *ptr, int order)
+{
+    const unsigned long pfn = ptr_to_pfn(ptr);
+
+    /* Catch double free and wrong orders */
+    if (!buddy_allocated(b, ptr, order))
+        return 1;
+
+    *frame_of(b, pfn) = BUDDY_FRAME_TAIL;
+    release_block(b, pfn, order);
+    ++b->frees;
+    b->used_frames -= 1UL << order;
+    return 0;
+}
+
+unsigned long buddy_free_frames(struct buddy_allocator *b)
+{
+    unsigned long ans = 0;
+    int i;
+
+    for (i = 0; i != BUDDY_ORDERS; ++i)
+    {
+        ans += b->free_count[i] << i;
+    }
+    return ans;
+}
+
+int buddy_largest_free_order(struct buddy_allocator *b)
+{
+    if (!b->order_mask)
+        return -1;
+    return bitmap64_highest(b->order_mask);
+}
@@ -0,0 +1,122 @@
+/**
+ * Binary buddy allocator for physical page frames.
+ *
+ * Memory is handed out in blocks of 2^order contiguous
+ * frames, naturally aligned to their own size. Free
+ * blocks are kept in one list per order and are linked
+ * through their first bytes, so no memory other than
+ * one byte per frame is required for metadata.
+ *
+ * Both allocation and deallocation run in O(log n):
+ * at most BUDDY_MAX_ORDER splits or merges.
+ *
+ * See:
+ *  https://en.wikipedia.org/wiki/Buddy_memory_allocation
+ */
+
+#ifndef BUDDY
+#define BUDDY
+
+#define BUDDY_PAGE_SHIFT 12
+#define BUDDY_PAGE_SIZE (1UL << BUDDY_PAGE_SHIFT)
+
+/**
+ * Biggest block is 2^BUDDY_MAX_ORDER frames (1GB),
+ * so that 2MB and 1GB pages can be allocated.
+ */
+#define BUDDY_MAX_ORDER 18
+#define BUDDY_ORDERS (BUDDY_MAX_ORDER + 1)
+
+/**
+ * Stored in the first bytes of every free block.
+ */
+struct buddy_block
+{
+    struct buddy_block *next;
+    struct buddy_block *prev;
+};
+
+struct buddy_allocator
+{
+    /* Number of the first frame described by "frames" */
+    unsigned long base_pfn;
+    /* Number of frames described by "frames" */
+    unsigned long frame_count;
+    /**
+     * One byte per frame, see buddy.c for the encoding.
+     * Frames that do not belong to any registered
+     * region are marked as reserved and never used.
+     */
+    unsigned char *frames;
+    /* Heads of the free lists, one per order */
+    struct buddy_block *free_list[BUDDY_ORDERS];
+    /* Number of blocks in each free list */
+    unsigned long free_count[BUDDY_ORDERS];
+    /* Bit n set when free_list[n] is not empty */
+    unsigned long order_mask;
+    /* Frames made available with buddy_add_region */
+    unsigned long managed_frames;
+    /* Statistics, failures are requests with no block big enough */
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures;
+    unsigned long used_frames;
+    unsigned long peak_used_frames;
+};
+
+/**
+ * Initialise an empty allocator able to describe
+ * frame_count frames starting from address base.
+ * The metadata buffer "frames" must be at least
+ * frame_count bytes long.
+ *
+ * No memory is available until buddy_add_region
+ * is called.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int buddy_init(struct buddy_allocator *b, void *base, unsigned long frame_count, unsigned char *frames);
+
+/**
+ * Make the frames in [start, end) available to the
+ * allocator. Partial frames at both ends are ignored.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int buddy_add_region(struct buddy_allocator *b, void *start, void *end);
+
+/**
+ * Allocate 2^order contiguous frames aligned to
+ * (2^order)*BUDDY_PAGE_SIZE bytes.
+ *
+ * Return a null pointer if no block is available.
+ */
+void *buddy_alloc(struct buddy_allocator *b, int order);
+
+/**
+ * Release a block obtained with buddy_alloc using
+ * the same order.
+ *
+ * Return 0 on success, nonzero if the pointer does not
+ * refer to an allocated block of the given order.
+ */
+int buddy_free(struct buddy_allocator *b, void *ptr, int order);
+
+/**
+ * Return nonzero if ptr is the beginning of an
+ * allocated block of the given order.
+ */
+int buddy_allocated(struct buddy_allocator *b, void *ptr, int order);
+
+/**
+ * Number of free frames.
+ */
+unsigned long buddy_free_frames(struct buddy_allocator *b);
+
+/**
+ * Order of the biggest free block, -1 if
+ * no memory is free.
+ */
+int buddy_largest_free_order(struct buddy_allocator *b);
+
+#endif
@@ -1,12 +1,26 @@
 #include "error64.h"
 #include "video64bit.h"
+#include "memory.h"
+#include "serial64.h"
+#include "klog.h"
 
 
 void panic64(const char *msg)
 {
+    /* A panic while dumping must not dump again */
+    static int panicking;
+
     set_background_color(7);
     set_foreground_color(8);
+    if (!panicking)
+    {
+        panicking = 1;
+        klog_drain();
+        memory_dump_stats();
+    }
+    /* Last, so that it is not scrolled away */
     printline64(msg);
+    serial_flush64();
     halt();
 }
 
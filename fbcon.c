@@ -0,0 +1,390 @@
+/**
+ * This file MUST be compiled as 64 BIT!
+ */
+
+#include "fbcon.h"
+#include "font.h"
+#include "multiboot.h"
+#include "vmm.h"
+
+/**
+ * A cell is a glyph plus one column and, through
+ * the descender row, one row of spacing, scaled by 2.
+ */
+#define CELL_SCALE 2
+#define CELL_WIDTH (CELL_SCALE * (FONT_WIDTH + 1))
+#define CELL_HEIGHT (CELL_SCALE * FONT_HEIGHT)
+
+/* Up to 3840x2160 */
+#define MAX_COLS 320
+#define MAX_ROWS 135
+
+#define PAGE_SIZE 0x1000
+
+extern u32 multiboot_info_structure;
+
+/**
+ * Mode set by the bootloader, copied by fbcon_probe64:
+ * memory_init gives the memory holding the multiboot
+ * info to the page allocator. bytes_per_pixel is 0
+ * when there is no mode fbcon can draw in.
+ */
+static unsigned long framebuffer_address;
+static unsigned int framebuffer_width, framebuffer_height;
+static int bytes_per_pixel;
+
+static unsigned char *framebuffer;
+/* Bytes per line of pixels */
+static unsigned long pitch;
+static int cols, rows;
+/* 32 bpp and 8 bytes aligned rows, see draw_row64 */
+static int wide_stores;
+
+/* Current position of the cursor */
+static int col, row;
+
+/**
+ * Cells to display, a ring of rows starting at
+ * "first" as the shadow copy of video64bit.c
+ */
+static short cells[MAX_ROWS][MAX_COLS];
+static int first;
+
+/**
+ * Cells drawn on the framebuffer, by row of the
+ * screen. -1 forces the cell to be drawn.
+ */
+static int shown[MAX_ROWS][MAX_COLS];
+
+/**
+ * Columns [dirty_begin, dirty_end) of each row of
+ * the screen may differ from what is shown.
+ */
+static short dirty_begin[MAX_ROWS], dirty_end[MAX_ROWS];
+
+/* Pixel values of the 16 VGA colors */
+static unsigned int palette[16];
+
+static const unsigned int vga_colors[16] =
+{
+    0x000000, 0x0000aa, 0x00aa00, 0x00aaaa,
+    0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+    0x555555, 0x5555ff, 0x55ff55, 0x55ffff,
+    0xff5555, 0xff55ff, 0xffff55, 0xffffff,
+};
+
+/**
+ * Place an 8 bit color component in the field of
+ * the pixel described by the multiboot info.
+ */
+static inline unsigned int component(unsigned int value, int position, int size)
+{
+    if (size > 8)
+        return (value << (size - 8)) << position;
+    return (value >> (8 - size)) << position;
+}
+
+static void rgb_palette(struct multiboot_info *mi)
+{
+    int i;
+
+    for (i = 0; i != 16; ++i)
+    {
+        const unsigned int rgb = vga_colors[i];
+        palette[i] =
+            component((rgb >> 16) & 0xff, mi->framebuffer_red_field_position, mi->framebuffer_red_mask_size)
+            | component((rgb >> 8) & 0xff, mi->framebuffer_green_field_position, mi->framebuffer_green_mask_size)
+            | component(rgb & 0xff, mi->framebuffer_blue_field_position, mi->framebuffer_blue_mask_size);
+    }
+}
+
+/**
+ * Indexed modes: use the entries of the bootloader
+ * palette nearest to the VGA colors.
+ */
+static void indexed_palette(struct multiboot_info *mi)
+{
+    const u8 *entries = (const u8 *)(unsigned long)mi->framebuffer_palette_addr;
+    int i, j;
+
+    for (i = 0; i != 16; ++i)
+    {
+        const int r = (vga_colors[i] >> 16) & 0xff;
+        const int g = (vga_colors[i] >> 8) & 0xff;
+        const int b = vga_colors[i] & 0xff;
+        unsigned int best = ~0U;
+
+        for (j = 0; j != mi->framebuffer_palette_num_colors; ++j)
+        {
+            const int dr = entries[3 * j] - r;
+            const int dg = entries[3 * j + 1] - g;
+            const int db = entries[3 * j + 2] - b;
+            const unsigned int distance = dr * dr + dg * dg + db * db;
+            if (distance < best)
+            {
+                best = distance;
+                palette[i] = j;
+            }
+        }
+    }
+}
+
+/**
+ * Row r of the screen in the ring of cells
+ */
+static inline short *cell_row(int r)
+{
+    return cells[(first + r) % rows];
+}
+
+static inline void mark_dirty(int r, int begin, int end)
+{
+    if (dirty_begin[r] >= dirty_end[r])
+    {
+        dirty_begin[r] = begin;
+        dirty_end[r] = end;
+        return;
+    }
+    if (begin < dirty_begin[r])
+        dirty_begin[r] = begin;
+    if (end > dirty_end[r])
+        dirty_end[r] = end;
+}
+
+static void clear_row(int r, short attribute)
+{
+    short *line = cell_row(r);
+    int c;
+
+    for (c = 0; c != cols; ++c)
+    {
+        line[c] = attribute & 0xff00;
+    }
+    mark_dirty(r, 0, cols);
+}
+
+/**
+ * Draw the two rows of pixels of a row of a glyph with
+ * 64 bit stores: each pixel of the font covers two
+ * pixels of a row.
+ */
+static void draw_row64(unsigned char *line, unsigned int bits, unsigned int fg, unsigned int bg)
+{
+    const unsigned long fg2 = fg | (unsigned long)fg << 32;
+    const unsigned long bg2 = bg | (unsigned long)bg << 32;
+    unsigned long *upper = (unsigned long *)line;
+    unsigned long *lower = (unsigned long *)(line + pitch);
+    int x;
+
+    for (x = 0; x != FONT_WIDTH + 1; ++x)
+    {
+        const unsigned long pixels = bits & (1U << (FONT_WIDTH - x)) ? fg2 : bg2;
+        upper[x] = pixels;
+        lower[x] = pixels;
+    }
+}
+
+/**
+ * Same for the other depths, a byte at a time
+ */
+static void draw_row(unsigned char *line, unsigned int bits, unsigned int fg, unsigned int bg)
+{
+    int x, b;
+
+    for (x = 0; x != CELL_WIDTH; ++x)
+    {
+        const unsigned int pixel = bits & (1U << (FONT_WIDTH - x / CELL_SCALE)) ? fg : bg;
+        unsigned char *p = line + x * bytes_per_pixel;
+
+        for (b = 0; b != bytes_per_pixel; ++b)
+        {
+            p[b] = pixel >> (8 * b);
+            p[b + pitch] = pixel >> (8 * b);
+        }
+    }
+}
+
+/**
+ * Draw a cell, each row of the font covers two rows
+ * of the framebuffer. Only writes, reading write
+ * combining memory is very slow.
+ */
+static void draw_cell(int r, int c, short cell)
+{
+    const unsigned char *glyph = font_glyph(cell & 0xff);
+    const unsigned int fg = palette[(cell >> 8) & 15];
+    const unsigned int bg = palette[(cell >> 12) & 15];
+    unsigned char *line = framebuffer + r * CELL_HEIGHT * pitch + c * CELL_WIDTH * bytes_per_pixel;
+    int y;
+
+    for (y = 0; y != FONT_HEIGHT; ++y)
+    {
+        /* The last column is the spacing, always background */
+        const unsigned int bits = (unsigned int)glyph[y] << 1;
+
+        if (wide_stores)
+            draw_row64(line, bits, fg, bg);
+        else
+            draw_row(line, bits, fg, bg);
+        line += CELL_SCALE * pitch;
+    }
+}
+
+/**
+ * Move the screen one row up, the last
+ * row becomes empty.
+ */
+static void scroll(short attribute)
+{
+    int r;
+
+    first = (first + 1) % rows;
+    clear_row(rows - 1, attribute);
+    /* Every row shows different text now */
+    for (r = 0; r != rows - 1; ++r)
+    {
+        mark_dirty(r, 0, cols);
+    }
+}
+
+void fbcon_probe64()
+{
+    struct multiboot_info *mi = (struct multiboot_info *)(unsigned long)multiboot_info_structure;
+
+    if (!mi || !(mi->flags & MULTIBOOT_FLAG_12))
+        return;
+    if (mi->framebuffer_bpp < 8 || mi->framebuffer_bpp > 32)
+        return;
+    if (mi->framebuffer_type == MULTIBOOT_FRAMEBUFFER_RGB)
+    {
+        rgb_palette(mi);
+    }
+    else if (mi->framebuffer_type == MULTIBOOT_FRAMEBUFFER_INDEXED
+        && mi->framebuffer_bpp == 8 && mi->framebuffer_palette_num_colors)
+    {
+        indexed_palette(mi);
+    }
+    else
+    {
+        /* EGA text: VGA text memory is displayed */
+        return;
+    }
+
+    framebuffer_address = mi->framebuffer_addr;
+    pitch = mi->framebuffer_pitch;
+    framebuffer_width = mi->framebuffer_width;
+    framebuffer_height = mi->framebuffer_height;
+    /* 15 bits per pixel take 2 bytes */
+    bytes_per_pixel = (mi->framebuffer_bpp + 7) / 8;
+}
+
+int fbcon_init64()
+{
+    unsigned long base, size;
+    int r, c;
+
+    if (!bytes_per_pixel)
+        return 1;
+
+    cols = framebuffer_width / CELL_WIDTH;
+    rows = framebuffer_height / CELL_HEIGHT;
+    if (cols > MAX_COLS)
+        cols = MAX_COLS;
+    if (rows > MAX_ROWS)
+        rows = MAX_ROWS;
+    if (!cols || !rows)
+    {
+        cols = rows = 0;
+        return 1;
+    }
+
+    /**
+     * The framebuffer is usually above the memory
+     * mapped at boot. As for VGA text memory, write
+     * combining sends the rows of a glyph as bursts.
+     */
+    base = framebuffer_address & ~(PAGE_SIZE - 1);
+    size = framebuffer_address - base + pitch * framebuffer_height;
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (vmm_map((void *)base, base, size, VMM_WRITE | VMM_WRITE_COMBINING))
+    {
+        cols = rows = 0;
+        return 1;
+    }
+
+    framebuffer = (unsigned char *)framebuffer_address;
+    wide_stores = bytes_per_pixel == sizeof(u32) && !((framebuffer_address | pitch) & 7);
+    for (r = 0; r != rows; ++r)
+    {
+        for (c = 0; c != cols; ++c)
+        {
+            shown[r][c] = -1;
+        }
+    }
+    return 0;
+}
+
+int fbcon_columns64()
+{
+    return cols;
+}
+
+int fbcon_rows64()
+{
+    return rows;
+}
+
+void fbcon_putc64(char c, short attribute)
+{
+    cell_row(row)[col] = (attribute & 0xff00) | (unsigned char)c;
+    mark_dirty(row, col, col + 1);
+    if (++col == cols)
+        fbcon_newline64(attribute);
+}
+
+void fbcon_newline64(short attribute)
+{
+    col = 0;
+    if (++row == rows)
+    {
+        scroll(attribute);
+        --row;
+    }
+}
+
+int fbcon_column64()
+{
+    return col;
+}
+
+void fbcon_clear64(short attribute)
+{
+    int r;
+
+    for (r = 0; r != rows; ++r)
+    {
+        clear_row(r, attribute);
+    }
+    col = 0; row = 0;
+}
+
+void fbcon_flush64()
+{
+    int r, c;
+
+    for (r = 0; r != rows; ++r)
+    {
+        const short *line = cell_row(r);
+
+        for (c = dirty_begin[r]; c < dirty_end[r]; ++c)
+        {
+            const unsigned short cell = line[c];
+            if (shown[r][c] != cell)
+            {
+                draw_cell(r, c, cell);
+                shown[r][c] = cell;
+            }
+        }
+        dirty_begin[r] = dirty_end[r] = 0;
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ * Text console drawn on the linear framebuffer set
+ * up by the bootloader (multiboot header flag 2).
+ *
+ * Characters are kept in a grid of cells with the
+ * same format as VGA text memory (attribute in the
+ * high byte). A flush draws only the cells that
+ * differ from what the framebuffer already shows,
+ * within the span of columns changed in each row,
+ * so after a scroll the blank ends of the lines are
+ * not drawn again.
+ *
+ * Every glyph is drawn scaled by 2. In 32 bits per
+ * pixel modes a pixel of the font is one 64 bit store
+ * of two pixels, other RGB depths and 8 bit indexed
+ * modes are written a byte at a time.
+ * A 1920x1080 mode gives 160 columns and 67 rows.
+ *
+ * Used by video64bit.c when available, see fbcon_init64.
+ */
+
+#ifndef FBCON
+#define FBCON
+
+/**
+ * Copy the graphics mode from the multiboot info.
+ * Must be called before memory_init, which may
+ * reuse the memory holding it.
+ */
+void fbcon_probe64();
+
+/**
+ * Map the framebuffer found by fbcon_probe64
+ * write combining. Must be called after vmm_init.
+ *
+ * Return 0 on success, nonzero if the bootloader
+ * did not set a usable graphics mode.
+ */
+int fbcon_init64();
+
+/**
+ * Size of the console in characters, 0 if
+ * fbcon_init64 failed.
+ */
+int fbcon_columns64();
+int fbcon_rows64();
+
+/**
+ * Write a character with the given VGA attribute
+ * (foreground in bits 8-11, background in bits 12-15)
+ * at the cursor and move it, scrolling at the end
+ * of the screen.
+ */
+void fbcon_putc64(char c, short attribute);
+
+/**
+ * Move the cursor to the beginning of the next row,
+ * the rest of the current one keeps its content.
+ */
+void fbcon_newline64(short attribute);
+
+/**
+ * Column of the cursor.
+ */
+int fbcon_column64();
+
+/**
+ * Fill the screen with spaces of the given attribute
+ * and move the cursor to the top left corner.
+ */
+void fbcon_clear64(short attribute);
+
+/**
+ * Draw the cells changed since the last flush.
+ */
+void fbcon_flush64();
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * Bitmap font of the framebuffer console, see fbcon.h.
+ *
+ * Glyphs are FONT_WIDTH x FONT_HEIGHT pixels, one byte
+ * per row with the leftmost pixel in bit FONT_WIDTH - 1.
+ * Capital letters and digits use the first 7 rows, the
+ * last one holds the descenders.
+ */
+
+#ifndef FONT
+#define FONT
+
+#define FONT_WIDTH 5
+#define FONT_HEIGHT 8
+
+/* Printable ASCII, from ' ' to '~' */
+#define FONT_FIRST ' '
+#define FONT_LAST '~'
+
+extern const unsigned char font_glyphs[FONT_LAST - FONT_FIRST + 1][FONT_HEIGHT];
+
+/**
+ * Rows of the glyph of c, characters out of
+ * the font are drawn as a space.
+ */
+static inline const unsigned char *font_glyph(unsigned char c)
+{
+    if (c < FONT_FIRST || c > FONT_LAST)
+        c = FONT_FIRST;
+    return font_glyphs[c - FONT_FIRST];
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "heap.h"
+#include "memory.h"
+
+#define PAGE_SIZE 4096UL
+
+/**
+ * Low bit of the size field, set for
+ * allocated blocks.
+ */
+#define BLOCK_USED 1UL
+
+struct heap_chunk
+{
+    struct heap_chunk *next;
+    struct heap_chunk *prev;
+    /* Chunk is 2^order pages */
+    unsigned long order;
+    unsigned long size;
+};
+
+/**
+ * Header in front of every block
+ */
+struct heap_block
+{
+    /* Block size, header included, and BLOCK_USED flag */
+    unsigned long size;
+    /* Size of the previous block in the chunk, 0 for the first */
+    unsigned long prev_size;
+};
+
+/**
+ * Free blocks also hold the free list links
+ */
+struct heap_free_block
+{
+    struct heap_block header;
+    struct heap_free_block *next;
+    struct heap_free_block *prev;
+};
+
+#define MIN_BLOCK_SIZE (sizeof(struct heap_free_block))
+
+static inline unsigned long block_size(struct heap_block *b)
+{
+    return b->size & ~BLOCK_USED;
+}
+
+static inline struct heap_block *first_block(struct heap_chunk *c)
+{
+    return (struct heap_block *)(c + 1);
+}
+
+static inline void *chunk_end(struct heap_chunk *c)
+{
+    return (char *)c + c->size;
+}
+
+/**
+ * Return the block after b or a null pointer
+ * if b is the last of the chunk.
+ */
+static inline struct heap_block *next_block(struct heap_chunk *c, struct heap_block *b)
+{
+    struct heap_block *next = (struct heap_block *)((char *)b + block_size(b));
+    return (void *)next < chunk_end(c) ? next : (void*)0;
+}
+
+static void free_list_push(struct heap *h, struct heap_block *b)
+{
+    struct heap_free_block *f = (struct heap_free_block *)b;
+    f->prev = (void*)0;
+    f->next = h->free_list;
+    if (f->next)
+        f->next->prev = f;
+    h->free_list = f;
+}
+
+static void free_list_remove(struct heap *h, struct heap_block *b)
+{
+    struct heap_free_block *f = (struct heap_free_block *)b;
+    if (f->prev)
+        f->prev->next = f->next;
+    else
+        h->free_list = f->next;
+    if (f->next)
+        f->next->prev = f->prev;
+}
+
+static struct heap_chunk *chunk_of(struct heap *h, void *ptr)
+{
+    struct heap_chunk *c;
+    for (c = h->chunks; c; c = c->next)
+    {
+        if ((void *)first_block(c) <= ptr && ptr < chunk_end(c))
+            return c;
+    }
+    return (void*)0;
+}
+
+/**
+ * Get a new chunk able to hold a block of
+ * the given size.
+ */
+static int heap_grow(struct heap *h, unsigned long size)
+{
+    struct heap_chunk *c;
+    struct heap_block *b;
+    unsigned long order = HEAP_MIN_CHUNK_ORDER;
+
+    while ((PAGE_SIZE << order) < size + sizeof(struct heap_chunk))
+        ++order;
+    c = kalloc_pages(order);
+    if (!c)
+        return 1;
+
+    c->order = order;
+    c->size = PAGE_SIZE << order;
+    c->prev = (void*)0;
+    c->next = h->chunks;
+    if (c->next)
+        c->next->prev = c;
+    h->chunks = c;
+
+    /* One free block spanning the whole chunk */
+    b = first_block(c);
+    b->size = c->size - sizeof(struct heap_chunk);
+    b->prev_size = 0;
+    free_list_push(h, b);
+
+    h->chunk_bytes += c->size;
+    if (h->chunk_bytes > h->peak_chunk_bytes)
+        h->peak_chunk_bytes = h->chunk_bytes;
+    return 0;
+}
+
+static void heap_shrink(struct heap *h, struct heap_chunk *c)
+{
+    free_list_remove(h, first_block(c));
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        h->chunks = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    h->chunk_bytes -= c->size;
+    kfree_pages(c, c->order);
+}
+
+void heap_init(struct heap *h)
+{
+    h->chunks = (void*)0;
+    h->free_list = (void*)0;
+    h->chunk_bytes = 0;
+    h->peak_chunk_bytes = 0;
+    h->used_bytes = 0;
+    h->peak_used_bytes = 0;
+    h->allocs = 0;
+    h->frees = 0;
+    h->failures = 0;
+}
+
+void *heap_alloc(struct heap *h, unsigned long size)
+{
+    struct heap_free_block *f;
+    struct heap_block *b;
+    unsigned long need;
+
+    if (!h || !size)
+        return (void*)0;
+
+    need = (size + sizeof(struct heap_block) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+    if (need < MIN_BLOCK_SIZE)
+        need = MIN_BLOCK_SIZE;
+
+    /* First fit, grow if nothing is big enough */
+    for (f = h->free_list; f; f = f->next)
+    {
+        if (block_size(&f->header) >= need)
+            break;
+    }
+    if (!f)
+    {
+        if (heap_grow(h, need))
+        {
+            ++h->failures;
+            return (void*)0;
+        }
+        f = h->free_list;
+    }
+
+    b = &f->header;
+    free_list_remove(h, b);
+    /* Split if the remainder can hold a block */
+    if (block_size(b) - need >= MIN_BLOCK_SIZE)
+    {
+        struct heap_chunk *c = chunk_of(h, b);
+        struct heap_block *rest = (struct heap_block *)((char *)b + need);
+        struct heap_block *after;
+
+        rest->size = block_size(b) - need;
+        rest->prev_size = need;
+        b->size = need;
+        after = next_block(c, rest);
+        if (after)
+            after->prev_size = rest->size;
+        free_list_push(h, rest);
+    }
+    b->size |= BLOCK_USED;
+
+    ++h->allocs;
+    h->used_bytes += block_size(b);
+    if (h->used_bytes > h->peak_used_bytes)
+        h->peak_used_bytes = h->used_bytes;
+
+    return b + 1;
+}
+
+int heap_owns(struct heap *h, void *ptr)
+{
+    return h && chunk_of(h, ptr);
+}
+
+int heap_free(struct heap *h, void *ptr)
+{
+    struct heap_chunk *c;
+    struct heap_block *b, *next;
+
+    if (!h || !ptr || ((unsigned long)ptr & (HEAP_ALIGN - 1)))
+        return 1;
+    c = chunk_of(h, ptr);
+    if (!c)
+        return 1;
+    b = (struct heap_block *)ptr - 1;
+    if (!(b->size & BLOCK_USED))
+        return 1;
+
+    b->size &= ~BLOCK_USED;
+    ++h->frees;
+    h->used_bytes -= b->size;
+
+    /* Merge with the following block */
+    next = next_block(c, b);
+    if (next && !(next->size & BLOCK_USED))
+    {
+        free_list_remove(h, next);
+        b->size += next->size;
+    }
+    /* Merge with the previous block */
+    if (b->prev_size)
+    {
+        struct heap_block *prev = (struct heap_block *)((char *)b - b->prev_size);
+        if (!(prev->size & BLOCK_USED))
+        {
+            free_list_remove(h, prev);
+            prev->size += b->size;
+            b = prev;
+        }
+    }
+    next = next_block(c, b);
+    if (next)
+        next->prev_size = b->size;
+    free_list_push(h, b);
+
+    /* Give back chunks without allocated blocks */
+    if (b == first_block(c) && !next)
+        heap_shrink(h, c);
+
+    return 0;
+}
+
+unsigned long heap_largest_free(struct heap *h)
+{
+    struct heap_free_block *f;
+    unsigned long ans = 0;
+
+    for (f = h->free_list; f; f = f->next)
+    {
+        if (block_size(&f->header) > ans)
+            ans = block_size(&f->header);
+    }
+    return ans ? ans - sizeof(struct heap_block) : 0;
+}
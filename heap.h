@@ -0,0 +1,77 @@
+/**
+ * General purpose heap that grows on demand.
+ *
+ * Memory is obtained from the page allocator in
+ * chunks of at least 2^HEAP_MIN_CHUNK_ORDER pages.
+ * Every chunk is split into blocks carrying their
+ * size and the size of the previous block, so that
+ * adjacent free blocks are merged in O(1). When all
+ * the blocks of a chunk are free the chunk is given
+ * back to the page allocator.
+ */
+
+#ifndef HEAP
+#define HEAP
+
+/**
+ * Chunks are at least 64KB
+ */
+#define HEAP_MIN_CHUNK_ORDER 4
+
+/**
+ * Alignment of returned pointers
+ */
+#define HEAP_ALIGN 16
+
+struct heap_chunk;
+struct heap_free_block;
+
+struct heap
+{
+    struct heap_chunk *chunks;
+    struct heap_free_block *free_list;
+    /* Bytes obtained from the page allocator */
+    unsigned long chunk_bytes;
+    unsigned long peak_chunk_bytes;
+    /* Bytes handed out, headers included */
+    unsigned long used_bytes;
+    unsigned long peak_used_bytes;
+    /* Failures are requests the page allocator could not satisfy */
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures;
+};
+
+/**
+ * Initialise an empty heap, no memory
+ * is allocated until needed.
+ */
+void heap_init(struct heap *h);
+
+/**
+ * Return a pointer to at least size bytes
+ * aligned to HEAP_ALIGN, or a null pointer if
+ * no memory is available.
+ */
+void *heap_alloc(struct heap *h, unsigned long size);
+
+/**
+ * Is ptr inside one of the chunks of the heap?
+ */
+int heap_owns(struct heap *h, void *ptr);
+
+/**
+ * Release memory obtained with heap_alloc.
+ *
+ * Return 0 on success, nonzero if ptr is not
+ * an allocated block of the heap.
+ */
+int heap_free(struct heap *h, void *ptr);
+
+/**
+ * Size of the biggest block heap_alloc can return
+ * without growing. Scans the free list.
+ */
+unsigned long heap_largest_free(struct heap *h);
+
+#endif
@@ -4,6 +4,7 @@
  */
 
 #include "helpers_32bit.h" 
+#include "multiboot.h"
 
 #define MAX_PHYS_ADDR_BIT 46
 
@@ -168,17 +169,107 @@ struct PDE_2MB_PAGE
     long long int xd : 1;       /* If IA32_EFER.NXE = 1, execute-disable or must be 0! */
 };
 
+/**
+ * Entries of the pdpt table that
+ * reference 1 GB pages
+ *
+ * See:
+ *  [Table 4-16. Format of a Page-Directory-Pointer-Table
+ *  Entry (PDPTE) that Maps a 1-GByte Page]
+ */
+struct PDPTE_1GB_PAGE
+{
+    long long int present : 1;  /* Is page present? */
+    long long int rw : 1;       /* Writable? */
+    long long int us : 1;       /* Accessible by user? */
+    long long int pwt : 1;      /* Page-level write-through? */
+    long long int pcd : 1;      /* Page-level cache disable? */
+    long long int accessed : 1; /* Page accessed? Managed by hw */
+    long long int dirty : 1;    /* Page written? Managed by hw */
+    long long int ps : 1;       /* MUST be 1! Page Size */
+    long long int global : 1;   /* Is the translation global? Unnecessary in this context. */
+    long long int : 3;          /* Ignored */
+    long long int pat : 1;      /* Page Attribute Table. Ignored, use 0. */
+    long long int : 17;         /* MUST be 0 */
+    long long int pta : (MAX_PHYS_ADDR_BIT - 1 - 30 + 1);
+    long long int : (51 - MAX_PHYS_ADDR_BIT + 1); /* MUST be 0 */
+    long long int : 7;          /* Ignored */
+    long long int pk : 4;       /* protection_key. Use 0 in this context */
+    long long int xd : 1;       /* If IA32_EFER.NXE = 1, execute-disable or must be 0! */
+};
+
+/**
+ * Page directories reserved after PDT in
+ * trampoline.S, each maps 1 GB with 2 MB pages.
+ * Must match PDT_COUNT in trampoline.S
+ */
+#define MAX_2MB_PAGE_DIRECTORIES 16
+
+/**
+ * One PDPT maps at most 512 GB
+ */
+#define MAX_1GB_PAGES 512
+
+#define GB_SHIFT 30
+
+/**
+ * End of the identity mapping built by
+ * initialize_64bits_page_tables, read by
+ * the 64 bit kernel.
+ */
+u64 identity_mapped_limit;
+
+/**
+ * Highest address of RAM or ACPI tables according
+ * to the multiboot info, 0 if unknown.
+ */
+static u64 highest_memory_address(struct multiboot_info *mi)
+{
+    u64 highest = 0;
+    if (!mi)
+        return 0;
+    if (mi->flags & MULTIBOOT_FLAG_6)
+    {
+        u32 ptr = mi->mmap_addr;
+        const u32 end = ptr + mi->mmap_length;
+        while (ptr < end)
+        {
+            struct multiboot_mmap_entry *entry = (struct multiboot_mmap_entry *)ptr;
+            /* Reserved ranges (devices) are not needed */
+            if (entry->type != MULTIBOOT_MEMORY_RESERVED
+                && entry->base_addr + entry->length > highest)
+            {
+                highest = entry->base_addr + entry->length;
+            }
+            ptr += entry->size + sizeof(entry->size);
+        }
+    }
+    else if (mi->flags & MULTIBOOT_FLAG_0)
+    {
+        /* mem_upper starts at 1MB and is in KB */
+        highest = (1ULL << 20) + ((u64)mi->mem_upper << 10);
+    }
+    return highest;
+}
+
 /**
  * See Intel Manual Vol. 3
  *  [4.5 4-LEVEL PAGING AND 5-LEVEL PAGING]
  *
+ * Identity map all the memory reported by the
+ * bootloader, rounded up to 1 GB. With 1 GB pages
+ * the PDPT maps memory directly, otherwise each
+ * PDPT entry references one of the page directories
+ * starting at pdt, filled with 2 MB pages.
  */
-void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt)
+void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt, u32 multiboot_info, int use_1gb_pages)
 {
     struct PML4E *pml4e = (struct PML4E *)pml4;
     struct PDPTE *pdpte = (struct PDPTE *)pdpt;
+    struct PDPTE_1GB_PAGE *pdpte1gb = (struct PDPTE_1GB_PAGE *)pdpt;
     struct PDE_2MB_PAGE *pde2mb = (struct PDE_2MB_PAGE *)pdt;
-    int i;
+    u64 highest = highest_memory_address((struct multiboot_info *)multiboot_info);
+    int gigabytes, i;
 
     if (sizeof(struct PML4E) != 8)
     {
@@ -188,11 +279,25 @@ void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt)
     {
         c_abort("sizeof(struct PDPTE) != 8");
     }
+    if (sizeof(struct PDPTE_1GB_PAGE) != 8)
+    {
+        c_abort("sizeof(struct PDPTE_1GB_PAGE) != 8");
+    }
     if (sizeof(struct PDE_2MB_PAGE) != 8)
     {
         c_abort("sizeof(struct PDE_2MB_PAGE) != 8");
     }
 
+    /* Map at least 1 GB, the kernel is somewhere in there */
+    gigabytes = (highest + (1ULL << GB_SHIFT) - 1) >> GB_SHIFT;
+    if (gigabytes < 1)
+        gigabytes = 1;
+    if (use_1gb_pages && gigabytes > MAX_1GB_PAGES)
+        gigabytes = MAX_1GB_PAGES;
+    if (!use_1gb_pages && gigabytes > MAX_2MB_PAGE_DIRECTORIES)
+        gigabytes = MAX_2MB_PAGE_DIRECTORIES;
+    identity_mapped_limit = (u64)gigabytes << GB_SHIFT;
+
     /**
      * May be useful: 
      *
@@ -208,20 +313,46 @@ void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt)
     pml4e->rw = 1;      /* writable */
     pml4e->pdtp = ((long long int)pdpte) >> 12;
 
+    if (use_1gb_pages)
+    {
+        /**
+         * Init 3rd level page
+         * One 1 GB page per entry, no 2nd level
+         */
+        for (i = 0; i != gigabytes; ++i)
+        {
+            (*pdpte1gb) = (struct PDPTE_1GB_PAGE){};
+
+            pdpte1gb->present = 1;
+            pdpte1gb->rw = 1;
+            pdpte1gb->ps = 1; /* 1GB page entry */
+            pdpte1gb->pta = i;  /* Identity mapping */
+
+            ++pdpte1gb;
+        }
+        return;
+    }
+
     /**
      * Init 3rd level page
-     * Only first entry is necessary
+     * One page directory per GB
      */
-    pdpte->present = 1; /* Valid entry */
-    pdpte->rw = 1;      /* writable */
-    pdpte->pdp = ((long long int)pde2mb) >> 12;;
+    for (i = 0; i != gigabytes; ++i)
+    {
+        (*pdpte) = (struct PDPTE){};
+
+        pdpte->present = 1; /* Valid entry */
+        pdpte->rw = 1;      /* writable */
+        pdpte->pdp = ((long long int)(pde2mb + 512 * i)) >> 12;
+
+        ++pdpte;
+    }
 
     /**
      * Init 2rd level page
-     * Map obly first 40 MB
+     * 512 entries of 2 MB per GB
      */
-    /* Use 400 MB by default, they should be enough */
-    for (i = 0; i != 200; ++i)
+    for (i = 0; i != gigabytes * 512; ++i)
     {
         (*pde2mb) = (struct PDE_2MB_PAGE){};
 
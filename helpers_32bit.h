@@ -2,6 +2,8 @@
 #ifndef HELPERS_32BIT
 #define HELPERS_32BIT
 
+#include "types.h"
+
 /**
  * @brief Noreturn function to display a message
  * and abort machine startup
@@ -14,7 +16,14 @@ void zero(void *ptr, int len);
 
 void initialize_page_directory(void *pd);
 
-void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt);
+/**
+ * Build the 4 level identity map of the memory
+ * described by the multiboot info and store its
+ * end in identity_mapped_limit.
+ */
+void initialize_64bits_page_tables(void *pml4, void *pdpt, void *pdt, u32 multiboot_info, int use_1gb_pages);
+
+extern u64 identity_mapped_limit;
 
 void intialise_gdt(void *ptr);
 
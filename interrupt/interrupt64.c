@@ -2,6 +2,7 @@
 #include "interrupt64.h"
 #include "../error64.h"
 #include "interrupt64_handlers.h"
+#include "pic64.h"
 
 #define INT_DIV0    0
 #define INT_DBG     3
@@ -118,6 +119,15 @@ void initialize_idt()
     /* [Interrupt 14—Page-Fault Exception (#PF)] */
     initialize_idt_entry(idt, INT_PFE, TYPE_64B_INTERRUPT_GATE, (u64)&handle_pfe);
 
+    /* IRQs of the PIC which are spurious, see pic64.h */
+    initialize_idt_entry(idt, PIC_VECTOR_BASE + IRQ_SPURIOUS, TYPE_64B_INTERRUPT_GATE, (u64)&handle_spurious_irq);
+    initialize_idt_entry(idt, PIC_VECTOR_BASE + 8 + IRQ_SPURIOUS, TYPE_64B_INTERRUPT_GATE, (u64)&handle_spurious_irq);
+
     load_idt_register(idt, IDT_LIMIT);
 }
 
+void set_interrupt_handler(int vector, void (*handler)())
+{
+    initialize_idt_entry(idt, vector, TYPE_64B_INTERRUPT_GATE, (u64)handler);
+}
+
@@ -26,6 +26,25 @@ void load_idt_register(struct idt_gate_descriptor *idt, unsigned short limit);
  */
 int store_idt_register(struct idt_gate_descriptor **idt, unsigned short *limit);
 
+/**
+ * Install an interrupt gate for an external
+ * interrupt. The handler must end with IRETQ.
+ */
+void set_interrupt_handler(int vector, void (*handler)());
+
+/**
+ * Disable interrupts, returning the previous RFLAGS
+ * to be given to irq_restore64.
+ */
+unsigned long irq_save64();
+void irq_restore64(unsigned long flags);
+void irq_enable64();
+
+/**
+ * Is RFLAGS.IF set in the given flags?
+ */
+#define IRQ_ENABLED(flags) (((flags) >> 9) & 1)
+
 
 #endif
 
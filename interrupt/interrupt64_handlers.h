@@ -69,4 +69,18 @@ void handle_gpe();
  */
 void handle_pfe();
 
+/**
+ * @brief IRQ 4, calls serial_interrupt64
+ *
+ */
+void handle_com1();
+
+/**
+ * @brief Spurious IRQ 7 and 15: nothing to do,
+ *  not even the EOI (every IRQ of the slave is
+ *  masked, so it never cascades one)
+ *
+ */
+void handle_spurious_irq();
+
 #endif
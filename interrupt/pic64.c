@@ -0,0 +1,72 @@
+#include "pic64.h"
+#include "../io64.h"
+
+#define PIC_MASTER_COMMAND  0x20
+#define PIC_MASTER_DATA     0x21
+#define PIC_SLAVE_COMMAND   0xA0
+#define PIC_SLAVE_DATA      0xA1
+
+/**
+ * Initialization command words, see
+ *  8259A PROGRAMMABLE INTERRUPT CONTROLLER datasheet
+ */
+#define ICW1_ICW4       0x01
+#define ICW1_INIT       0x10
+#define ICW4_8086       0x01
+/* Slave on IRQ 2 of the master */
+#define ICW3_MASTER     0x04
+#define ICW3_SLAVE      0x02
+
+#define PIC_EOI         0x20
+
+/**
+ * Give the old controllers time to process a
+ * command: port 0x80 is unused (POST codes).
+ */
+static void io_wait()
+{
+    outputb64(0x80, 0);
+}
+
+void pic_remap64()
+{
+    outputb64(PIC_MASTER_COMMAND, ICW1_INIT | ICW1_ICW4);
+    io_wait();
+    outputb64(PIC_SLAVE_COMMAND, ICW1_INIT | ICW1_ICW4);
+    io_wait();
+    outputb64(PIC_MASTER_DATA, PIC_VECTOR_BASE);
+    io_wait();
+    outputb64(PIC_SLAVE_DATA, PIC_VECTOR_BASE + 8);
+    io_wait();
+    outputb64(PIC_MASTER_DATA, ICW3_MASTER);
+    io_wait();
+    outputb64(PIC_SLAVE_DATA, ICW3_SLAVE);
+    io_wait();
+    outputb64(PIC_MASTER_DATA, ICW4_8086);
+    io_wait();
+    outputb64(PIC_SLAVE_DATA, ICW4_8086);
+    io_wait();
+
+    /* Everything masked but the cascade */
+    outputb64(PIC_MASTER_DATA, 0xff & ~(1 << 2));
+    outputb64(PIC_SLAVE_DATA, 0xff);
+}
+
+void pic_mask64(int irq)
+{
+    const unsigned short port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outputb64(port, inputb64(port) | (1 << (irq & 7)));
+}
+
+void pic_unmask64(int irq)
+{
+    const unsigned short port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outputb64(port, inputb64(port) & ~(1 << (irq & 7)));
+}
+
+void pic_eoi64(int irq)
+{
+    if (irq >= 8)
+        outputb64(PIC_SLAVE_COMMAND, PIC_EOI);
+    outputb64(PIC_MASTER_COMMAND, PIC_EOI);
+}
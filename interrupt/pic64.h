@@ -0,0 +1,37 @@
+/**
+ * Legacy 8259A programmable interrupt controllers
+ * (master and slave), delivering IRQ 0-15.
+ *
+ * At reset IRQ 0-7 use vectors 8-15, the same as
+ * processor exceptions: pic_remap64 moves them
+ * after the 32 exceptions.
+ *
+ * See:
+ *  https://wiki.osdev.org/8259_PIC
+ */
+#ifndef PIC64
+#define PIC64
+
+/**
+ * Vector of IRQ 0, IRQ n uses PIC_VECTOR_BASE + n
+ */
+#define PIC_VECTOR_BASE 0x20
+
+#define IRQ_COM1 4
+/* Raised by the master when no IRQ is really pending */
+#define IRQ_SPURIOUS 7
+
+/**
+ * Move IRQs to PIC_VECTOR_BASE, all masked.
+ */
+void pic_remap64();
+
+void pic_mask64(int irq);
+void pic_unmask64(int irq);
+
+/**
+ * Signal the end of the interrupt handler of irq.
+ */
+void pic_eoi64(int irq);
+
+#endif
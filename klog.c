@@ -0,0 +1,146 @@
+#include "klog.h"
+#include "smp.h"
+#include "string64.h"
+#include "video64bit.h"
+#include "status_operations64.h"
+
+struct klog_record
+{
+    /* Sequence number + 1 once complete, 0 while written */
+    unsigned long seq;
+    unsigned long tsc;
+    const char *fmt;
+    unsigned long args[KLOG_ARGS];
+    unsigned short cpu;
+    unsigned char level;
+} __attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+struct klog_ring
+{
+    /* Next sequence number to reserve */
+    unsigned long head __attribute__ ((aligned (CACHE_LINE_SIZE)));
+    /* Next sequence number to print */
+    unsigned long tail;
+    struct klog_record records[KLOG_RECORDS];
+};
+
+static struct klog_ring rings[MAX_CPUS];
+static unsigned long dropped;
+static int draining;
+
+/* See log.h */
+int log_level = KLOG_DEBUG;
+
+int log_set_level(int level)
+{
+    const int old = log_level;
+    log_level = level;
+    return old;
+}
+
+static const char *level_names[] = { "ERR", "WRN", "INF", "DBG" };
+
+void klog_write(int level, const char *fmt, unsigned long a0, unsigned long a1,
+    unsigned long a2, unsigned long a3)
+{
+    struct klog_ring *ring = &rings[smp_processor_id()];
+    const unsigned long seq = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    struct klog_record *r = &ring->records[seq & (KLOG_RECORDS - 1)];
+
+    /* Readers skip the record until it is complete */
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->tsc = so_read_tsc();
+    r->fmt = fmt;
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    r->args[3] = a3;
+    r->cpu = smp_processor_id();
+    r->level = level;
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy the next record of a ring to out.
+ *
+ * Return 0 on success, nonzero if the ring
+ * has no complete record to print.
+ */
+static int next_record(struct klog_ring *ring, struct klog_record *out)
+{
+    const unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    struct klog_record *r;
+
+    /* Records overwritten before being printed */
+    if (head - ring->tail > KLOG_RECORDS)
+    {
+        dropped += head - ring->tail - KLOG_RECORDS;
+        ring->tail = head - KLOG_RECORDS;
+    }
+    while (ring->tail != head)
+    {
+        r = &ring->records[ring->tail & (KLOG_RECORDS - 1)];
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != ring->tail + 1)
+        {
+            /* Still being written, print it later */
+            return 1;
+        }
+        *out = *r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        /* Overwritten while copying, it is lost */
+        if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != ring->tail + 1)
+        {
+            ++dropped;
+            ++ring->tail;
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+void klog_drain()
+{
+    struct klog_record pending[MAX_CPUS];
+    int valid[MAX_CPUS];
+    char message[KPRINTF64_BUFFER_SIZE];
+    int i;
+
+    if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE))
+        return;
+
+    for (i = 0; i != MAX_CPUS; ++i)
+        valid[i] = !next_record(&rings[i], &pending[i]);
+
+    /* Merge the rings by timestamp */
+    for (;;)
+    {
+        int oldest = -1;
+        for (i = 0; i != MAX_CPUS; ++i)
+        {
+            if (valid[i] && (oldest < 0 || pending[i].tsc < pending[oldest].tsc))
+                oldest = i;
+        }
+        if (oldest < 0)
+            break;
+
+        {
+            const struct klog_record *r = &pending[oldest];
+            ksnprintf64(message, sizeof(message), r->fmt,
+                r->args[0], r->args[1], r->args[2], r->args[3]);
+            kprintf64("[%lu] cpu%d %s %s\n", r->tsc, r->cpu,
+                r->level < sizeof(level_names) / sizeof(*level_names) ? level_names[r->level] : "???",
+                message);
+        }
+        ++rings[oldest].tail;
+        valid[oldest] = !next_record(&rings[oldest], &pending[oldest]);
+    }
+
+    if (dropped)
+    {
+        kprintf64("klog: %lu records dropped\n", dropped);
+        dropped = 0;
+    }
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,61 @@
+/**
+ * Kernel log: records written by any context
+ * (interrupts and VM exit handlers included) and
+ * printed later, when nothing urgent is running.
+ *
+ * Logging a record costs a RDTSC, an atomic
+ * increment and a few stores: the format string
+ * and its arguments are copied as they are, and
+ * formatted (see ksnprintf64) only by klog_drain,
+ * called when the kernel is idle and on panic.
+ *
+ * Every processor has its own ring of records, so
+ * processors never contend. Producers on the same
+ * processor (code and the interrupts preempting it)
+ * reserve slots with an atomic increment, no lock
+ * is taken. When a ring is full the oldest records
+ * are overwritten and counted as dropped.
+ */
+#ifndef KLOG
+#define KLOG
+
+#define KLOG_ERROR      0
+#define KLOG_WARNING    1
+#define KLOG_INFO       2
+#define KLOG_DEBUG      3
+
+/* Arguments stored with each record */
+#define KLOG_ARGS 4
+/* Records per processor, a power of 2 */
+#define KLOG_RECORDS 256
+
+/**
+ * Log a record. fmt must stay valid until it is
+ * printed (a string literal), and so must the
+ * strings given for %s. Arguments are stored as
+ * unsigned long, pointers need a cast:
+ *
+ *  klog(KLOG_DEBUG, "exit %lx at %p", reason, (unsigned long)rip);
+ *
+ * More than KLOG_ARGS arguments do not compile.
+ * The arguments are passed in registers, missing
+ * ones as 0: nothing is built on the stack.
+ */
+#define klog(level, fmt, ...) \
+    ((void)sizeof(char[KLOG_ARGS + 1 - sizeof((unsigned long[]){ 0, ##__VA_ARGS__ }) / sizeof(unsigned long)]), \
+    KLOG_WRITE(level, fmt, ##__VA_ARGS__, 0, 0, 0, 0))
+#define KLOG_WRITE(level, fmt, a0, a1, a2, a3, ...) \
+    klog_write(level, fmt, (unsigned long)(a0), (unsigned long)(a1), \
+        (unsigned long)(a2), (unsigned long)(a3))
+
+void klog_write(int level, const char *fmt, unsigned long a0, unsigned long a1,
+    unsigned long a2, unsigned long a3);
+
+/**
+ * Print the records logged since the last call,
+ * oldest first, on the console. Does nothing if
+ * another call is in progress.
+ */
+void klog_drain();
+
+#endif
@@ -38,6 +38,13 @@ void print_multiboot(struct multiboot_info *mi)
         printline32("VBE info available!");
     else
         printline32("VBE info NOT available!");
+
+    if (mi->flags & MULTIBOOT_FLAG_12)
+    {
+        putstr32("FRAMEBUFFER:  "); puti32(mi->framebuffer_width);
+        putc32('x'); puti32(mi->framebuffer_height);
+        putc32('x'); puti32(mi->framebuffer_bpp); newline32();
+    }
 }
 
 /**
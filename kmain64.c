@@ -4,6 +4,8 @@
 
 #include "video64bit.h"
 #include "vmx/vm64.h"
+#include "memory.h"
+#include "klog.h"
 
 void main64()
 {
@@ -11,6 +13,10 @@ void main64()
     printline64("Hello 64 bit!");
     printline64("Long Mode Activated!");
     printline64("Good Bye!");
+    /* Nothing else running, prepare zeroed pages for the VM */
+    memory_idle();
     start_vm();
+    /* Idle: print what the VM exits logged */
+    klog_drain();
 }
 
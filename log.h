@@ -0,0 +1,72 @@
+/**
+ * Diagnostics that can be compiled out.
+ *
+ * A file defines LOG_SUBSYSTEM before including
+ * this header, then uses:
+ *  -log_error, log_warning, log_info, log_debug
+ *   to print a line right away (kprintf64, the
+ *   newline is added)
+ *  -log_record(level, ...) to store it in the
+ *   kernel log, for hot paths (see klog.h)
+ *
+ * Messages above LOG_LEVEL, or of subsystems not
+ * in LOG_SUBSYSTEMS, are compiled to nothing: the
+ * condition is a constant, arguments are not even
+ * evaluated. Both are set from the Makefile, e.g.
+ *  make LOG_LEVEL=KLOG_ERROR
+ *  make LOG_SUBSYSTEMS="LOG_VMX|LOG_TR"
+ *
+ * Messages compiled in are also filtered at run
+ * time by log_set_level.
+ */
+#ifndef LOG
+#define LOG
+
+#include "klog.h"
+#include "video64bit.h"
+
+#define LOG_VMX     (1 << 0)
+#define LOG_MEMORY  (1 << 1)
+#define LOG_TR      (1 << 2)
+#define LOG_ALL     (~0)
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL KLOG_DEBUG
+#endif
+
+#ifndef LOG_SUBSYSTEMS
+#define LOG_SUBSYSTEMS LOG_ALL
+#endif
+
+#ifndef LOG_SUBSYSTEM
+#error "LOG_SUBSYSTEM must be defined before including log.h"
+#endif
+
+/**
+ * Run time level, KLOG_DEBUG at boot.
+ * Return the previous one.
+ */
+int log_set_level(int level);
+extern int log_level;
+
+#define LOG_ENABLED(level) \
+    ((level) <= LOG_LEVEL && (LOG_SUBSYSTEM & (LOG_SUBSYSTEMS)))
+
+#define log_print(level, fmt, ...) \
+    do { \
+        if (LOG_ENABLED(level) && (level) <= log_level) \
+            kprintf64(fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define log_error(fmt, ...)     log_print(KLOG_ERROR, fmt, ##__VA_ARGS__)
+#define log_warning(fmt, ...)   log_print(KLOG_WARNING, fmt, ##__VA_ARGS__)
+#define log_info(fmt, ...)      log_print(KLOG_INFO, fmt, ##__VA_ARGS__)
+#define log_debug(fmt, ...)     log_print(KLOG_DEBUG, fmt, ##__VA_ARGS__)
+
+#define log_record(level, fmt, ...) \
+    do { \
+        if (LOG_ENABLED(level) && (level) <= log_level) \
+            klog(level, fmt, ##__VA_ARGS__); \
+    } while (0)
+
+#endif
@@ -1,11 +1,22 @@
+#define LOG_SUBSYSTEM LOG_MEMORY
+
 #include "memory.h"
 
 // Include submodules
-#include "modules/C-page-allocator/page_allocator.h"
 #include "modules/C-memory-manager/memory_manager.h"
 
+#include "buddy.h"
+#include "slab.h"
+#include "heap.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "acpi.h"
+#include "status_operations64.h"
+#include "multiboot.h"
 #include "error64.h"
 #include "video64bit.h"
+#include "string64.h"
+#include "log.h"
 
 /**
  * External variable defined in
@@ -13,6 +24,12 @@
  */
 extern void *_heap_base;
 
+/**
+ * Physical address of the multiboot info
+ * structure, saved by header.S
+ */
+extern u32 multiboot_info_structure;
+
 /**
  * Align a pointer to the beginning of the next empty page.
  * If the pointer refer to the beginning of a page it is
@@ -26,74 +43,973 @@ static void *aling_to_page(void *ptr)
         : ptr;
 }
 
-const long pages_used_for_synamic_memory = 10;
+/**
+ * kalloc/kfree work on 2^dynamic_memory_order pages
+ */
+const int dynamic_memory_order = 4;
 const unsigned long page_size = (1L << 12);
 
-static struct page_allocator pa;
 /**
- * Bitfield for page allocator
+ * Upper bound of the identity mapping built by
+ * initialize_64bits_page_tables (helpers_32bit.c).
+ * Memory above is unreachable.
+ */
+extern u64 identity_mapped_limit;
+
+/**
+ * Maximum number of distinct usable ranges kept
+ * from the bootloader memory map.
+ */
+#define MAX_MEMORY_REGIONS 32
+
+struct memory_region
+{
+    unsigned long start;
+    unsigned long end;
+    /* NUMA node owning the region */
+    int node;
+};
+
+/**
+ * Usable RAM, sorted by address and not overlapping.
+ */
+static struct memory_region usable_regions[MAX_MEMORY_REGIONS];
+static int usable_region_count;
+
+/**
+ * One page allocator per NUMA node, with the ACPI
+ * proximity domain it was created for. Without a
+ * SRAT all memory belongs to node 0.
+ */
+struct numa_node
+{
+    struct buddy_allocator pa;
+    unsigned int domain;
+};
+static struct numa_node nodes[MAX_NUMA_NODES];
+static int node_count = 1;
+
+/**
+ * Node of each processor
+ */
+static int cpu_node[MAX_CPUS];
+
+/**
+ * Protects the allocators of all nodes,
+ * zero_pool and scrub_queue.
+ */
+static spinlock_t page_lock = SPINLOCK_INIT;
+
+/**
+ * Per-processor stack of free pages.
+ * kalloc_page and kfree_page only touch the
+ * magazine of the current processor, the global
+ * allocator is locked only to move a batch of
+ * pages when it is empty or full.
+ *
+ * Interrupt handlers must not allocate pages,
+ * the magazine is not protected against them.
+ */
+#define MAGAZINE_SIZE 32
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+struct page_magazine
+{
+    void *pages[MAGAZINE_SIZE];
+    int count;
+} __attribute__ ((aligned (CACHE_LINE_SIZE)));
+static struct page_magazine magazines[MAX_CPUS];
+
+/**
+ * Pages already filled with zeroes, handed out
+ * by kalloc_page_zeroed without clearing them.
+ * Refilled by memory_idle.
+ */
+#define ZERO_POOL_SIZE 64
+static void *zero_pool[ZERO_POOL_SIZE];
+static int zero_pool_count;
+
+/**
+ * Pages released with kfree_page waiting to be
+ * cleared by memory_idle and moved to zero_pool.
+ * Together with zero_pool at most ZERO_POOL_SIZE
+ * pages are kept.
+ */
+static void *scrub_queue[ZERO_POOL_SIZE];
+static int scrub_count;
+
+/**
+ * Small kalloc requests are served by these caches,
+ * the bigger ones by mm_malloc.
+ */
+static const unsigned long kalloc_sizes[] = { 64, 128, 256, 512, 1024, 2048 };
+static const char *const kalloc_names[] = {
+    "kalloc-64", "kalloc-128", "kalloc-256", "kalloc-512", "kalloc-1024", "kalloc-2048"
+};
+#define KALLOC_CLASSES (sizeof(kalloc_sizes)/sizeof(*kalloc_sizes))
+static struct kmem_cache *kalloc_caches[KALLOC_CLASSES];
+
+/**
+ * Region managed by mm_malloc
+ */
+static void *kdyn_begin, *kdyn_end;
+
+/**
+ * Takes over when mm_malloc runs out of memory,
+ * growing and shrinking with the demand.
+ */
+static struct heap kheap;
+
+/**
+ * Counters of the kalloc backends not keeping
+ * their own, see memory_dump_stats.
  */
-static char page_bits[4096];
+struct kalloc_counters
+{
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures;
+};
+static struct kalloc_counters slab_counters;
+static struct kalloc_counters mm_counters;
+static unsigned long kalloc_failures;
+static unsigned long kalloc_page_failures;
+
+int numa_node_count()
+{
+    return node_count;
+}
+
+int numa_local_node()
+{
+    return cpu_node[smp_processor_id()];
+}
+
+/**
+ * Allocate from the given node, then from the
+ * others in turn. page_lock must be held.
+ * The distances between nodes (ACPI SLIT) are
+ * not known, so every remote node is as good.
+ */
+static void *node_alloc(int node, int order)
+{
+    int i;
+    for (i = 0; i != node_count; ++i)
+    {
+        void *ptr = buddy_alloc(&nodes[(node + i) % node_count].pa, order);
+        if (ptr)
+            return ptr;
+    }
+    return (void*)0;
+}
+
+/**
+ * Node whose allocator handed out the block,
+ * -1 if ptr is not an allocated block.
+ */
+static int node_of(void *ptr, int order)
+{
+    int i;
+    for (i = 0; i != node_count; ++i)
+    {
+        if (buddy_allocated(&nodes[i].pa, ptr, order))
+            return i;
+    }
+    return -1;
+}
+
+void *kalloc_pages(int order)
+{
+    void *ptr;
+    spin_lock(&page_lock);
+    ptr = node_alloc(numa_local_node(), order);
+    spin_unlock(&page_lock);
+    return ptr;
+}
+
+void kfree_pages(void *ptr, int order)
+{
+    int node, error = 1;
+    spin_lock(&page_lock);
+    node = node_of(ptr, order);
+    if (node >= 0)
+        error = buddy_free(&nodes[node].pa, ptr, order);
+    spin_unlock(&page_lock);
+    if (error)
+    {
+        panic64("buddy_free");
+    }
+}
+
+static int valid_huge_class(int size_class)
+{
+    return size_class == HUGE_PAGE_2MB || size_class == HUGE_PAGE_1GB;
+}
+
+void *kalloc_huge(int size_class)
+{
+    if (!valid_huge_class(size_class))
+        return (void*)0;
+    return kalloc_pages(size_class);
+}
+
+void kfree_huge(void *ptr, int size_class)
+{
+    if (!valid_huge_class(size_class))
+    {
+        panic64("kfree_huge");
+    }
+    kfree_pages(ptr, size_class);
+}
+
+/**
+ * Fill a page with zeroes, see memset64.
+ */
+static void clear_page(void *page)
+{
+    memset64(page, 0, page_size);
+}
+
+/**
+ * Is the page waiting to be cleared or already
+ * in the zero pool? page_lock must be held.
+ */
+static int pool_contains(void *page)
+{
+    int i;
+    for (i = 0; i != scrub_count; ++i)
+    {
+        if (scrub_queue[i] == page)
+            return 1;
+    }
+    for (i = 0; i != zero_pool_count; ++i)
+    {
+        if (zero_pool[i] == page)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Move up to MAGAZINE_BATCH pages into an empty
+ * magazine. When the local node is exhausted the
+ * pages kept for zeroing are used, then remote
+ * nodes.
+ */
+static void magazine_refill(struct page_magazine *m)
+{
+    const int node = numa_local_node();
+    spin_lock(&page_lock);
+    while (m->count != MAGAZINE_BATCH)
+    {
+        void *page = buddy_alloc(&nodes[node].pa, 0);
+        if (!page && scrub_count)
+            page = scrub_queue[--scrub_count];
+        if (!page && zero_pool_count)
+            page = zero_pool[--zero_pool_count];
+        if (!page)
+            page = node_alloc(node, 0);
+        if (!page)
+            break;
+        m->pages[m->count++] = page;
+    }
+    spin_unlock(&page_lock);
+}
+
+/**
+ * Release the MAGAZINE_BATCH oldest pages of a full
+ * magazine. They refill the scrub queue when it has
+ * room, otherwise they go back to the buddy allocator.
+ */
+static void magazine_drain(struct page_magazine *m)
+{
+    int i;
+    spin_lock(&page_lock);
+    for (i = 0; i != MAGAZINE_BATCH; ++i)
+    {
+        void *page = m->pages[i];
+        if (pool_contains(page))
+        {
+            spin_unlock(&page_lock);
+            panic64("kfree_page: double free");
+        }
+        if (zero_pool_count + scrub_count != ZERO_POOL_SIZE)
+        {
+            scrub_queue[scrub_count++] = page;
+        }
+        else if (buddy_free(&nodes[node_of(page, 0)].pa, page, 0))
+        {
+            spin_unlock(&page_lock);
+            panic64("kfree_page");
+        }
+    }
+    spin_unlock(&page_lock);
+    for (i = MAGAZINE_BATCH; i != m->count; ++i)
+    {
+        m->pages[i - MAGAZINE_BATCH] = m->pages[i];
+    }
+    m->count -= MAGAZINE_BATCH;
+}
 
 void *kalloc_page()
 {
-    return page_allocator_allocate(&pa);
+    struct page_magazine *m = &magazines[smp_processor_id()];
+    if (!m->count)
+    {
+        magazine_refill(m);
+        if (!m->count)
+        {
+            ++kalloc_page_failures;
+            return (void*)0;
+        }
+    }
+    return m->pages[--m->count];
+}
+
+void *kalloc_page_node(int node)
+{
+    void *page;
+    if (node < 0 || node >= node_count)
+        return (void*)0;
+    /* Magazines are filled from the local node */
+    if (node == numa_local_node())
+        return kalloc_page();
+    spin_lock(&page_lock);
+    page = node_alloc(node, 0);
+    spin_unlock(&page_lock);
+    if (!page)
+        ++kalloc_page_failures;
+    return page;
+}
+
+void *kalloc_page_zeroed()
+{
+    void *page = (void*)0;
+    spin_lock(&page_lock);
+    if (zero_pool_count)
+        page = zero_pool[--zero_pool_count];
+    spin_unlock(&page_lock);
+    if (page)
+        return page;
+    /* Slow path, pool empty */
+    page = kalloc_page();
+    if (page)
+        clear_page(page);
+    return page;
 }
 
 void kfree_page(void *page)
 {
-    if (page_allocator_free(&pa, page))
+    struct page_magazine *m = &magazines[smp_processor_id()];
+    const int node = node_of(page, 0);
+    int i;
+    /* Pages in magazines are still allocated for the buddy allocator */
+    if (node < 0)
+    {
+        panic64("kfree_page");
+    }
+    /* Remote pages go straight back to their node */
+    if (node != numa_local_node())
+    {
+        spin_lock(&page_lock);
+        if (pool_contains(page))
+        {
+            spin_unlock(&page_lock);
+            panic64("kfree_page: double free");
+        }
+        if (buddy_free(&nodes[node].pa, page, 0))
+        {
+            spin_unlock(&page_lock);
+            panic64("kfree_page");
+        }
+        spin_unlock(&page_lock);
+        return;
+    }
+    for (i = 0; i != m->count; ++i)
+    {
+        if (m->pages[i] == page)
+            panic64("kfree_page: double free");
+    }
+    if (m->count == MAGAZINE_SIZE)
+    {
+        magazine_drain(m);
+    }
+    m->pages[m->count++] = page;
+}
+
+/**
+ * Add a page cleared by memory_idle to zero_pool.
+ * page_lock is not held while clearing, so other
+ * processors may have filled the scrub queue in the
+ * meantime: then the page goes back to the buddy
+ * allocator.
+ */
+static void zero_pool_add(void *page)
+{
+    spin_lock(&page_lock);
+    if (zero_pool_count + scrub_count < ZERO_POOL_SIZE)
+    {
+        zero_pool[zero_pool_count++] = page;
+    }
+    else if (buddy_free(&nodes[node_of(page, 0)].pa, page, 0))
+    {
+        spin_unlock(&page_lock);
+        panic64("memory_idle");
+    }
+    spin_unlock(&page_lock);
+}
+
+void memory_idle()
+{
+    void *page;
+    /* Clear freed pages first, they cost no allocation */
+    for (;;)
+    {
+        spin_lock(&page_lock);
+        page = scrub_count ? scrub_queue[--scrub_count] : (void*)0;
+        spin_unlock(&page_lock);
+        if (!page)
+            break;
+        clear_page(page);
+        zero_pool_add(page);
+    }
+    /* Then top up the pool */
+    for (;;)
     {
-        panic64("page_allocator_free");
-    };
+        spin_lock(&page_lock);
+        page = zero_pool_count + scrub_count != ZERO_POOL_SIZE ? buddy_alloc(&nodes[numa_local_node()].pa, 0) : (void*)0;
+        spin_unlock(&page_lock);
+        if (!page)
+            break;
+        clear_page(page);
+        zero_pool_add(page);
+    }
 }
 
 void *kalloc(unsigned long size)
 {
-    return mm_malloc(size);
+    int i;
+    void *ptr;
+    for (i = 0; i != KALLOC_CLASSES; ++i)
+    {
+        if (size <= kalloc_sizes[i])
+        {
+            ptr = kmem_cache_alloc(kalloc_caches[i]);
+            if (ptr)
+                ++slab_counters.allocs;
+            else
+                ++slab_counters.failures;
+            return ptr;
+        }
+    }
+    ptr = mm_malloc(size);
+    if (ptr)
+    {
+        ++mm_counters.allocs;
+        return ptr;
+    }
+    ++mm_counters.failures;
+    ptr = heap_alloc(&kheap, size);
+    if (!ptr)
+        ++kalloc_failures;
+    return ptr;
 }
 /**
  * Free kernel dynamic memory.
  */
+/**
+ * Is cache one of the caches kalloc serves small
+ * sizes from? The slab header found by masking a
+ * heap address may be any data: the magic alone
+ * is not trusted.
+ */
+static int is_kalloc_cache(struct kmem_cache *cache)
+{
+    int i;
+    for (i = 0; i != KALLOC_CLASSES; ++i)
+    {
+        if (cache && kalloc_caches[i] == cache)
+            return 1;
+    }
+    return 0;
+}
+
 void kfree(void *ptr)
 {
-    mm_free(ptr);
+    struct kmem_cache *cache;
+
+    if (!ptr)
+        return;
+    if (kdyn_begin <= ptr && ptr < kdyn_end)
+    {
+        mm_free(ptr);
+        ++mm_counters.frees;
+        return;
+    }
+    /* Slabs first: found in O(1), heap_owns walks the chunks */
+    cache = kmem_cache_of(ptr);
+    if (is_kalloc_cache(cache))
+    {
+        if (kmem_cache_free(cache, ptr))
+        {
+            panic64("kfree");
+        }
+        ++slab_counters.frees;
+    }
+    else if (heap_owns(&kheap, ptr))
+    {
+        if (heap_free(&kheap, ptr))
+        {
+            panic64("heap_free");
+        }
+    }
+    else
+    {
+        panic64("kfree");
+    }
 }
 
+unsigned long kalloc_high_water_mark()
+{
+    return (kdyn_end - kdyn_begin) + kheap.peak_chunk_bytes;
+}
 
-void memory_init()
+static void put_stat(const char *name, unsigned long value)
 {
-    // get beginning of page buffer base
-    void *page_buffer = aling_to_page(&_heap_base);
-    // init paging subsystem
-    putstr64("Initializing page subsystem... ");
-    if (!page_allocator_init(&pa, page_buffer, page_size, page_bits, sizeof(page_bits)*8UL))
+    putstr64(" ");
+    putstr64(name);
+    putstr64("=");
+    putlu64(value);
+}
+
+static void put_counters(const char *name, struct kalloc_counters *c)
+{
+    putstr64(name);
+    put_stat("allocs", c->allocs);
+    put_stat("frees", c->frees);
+    put_stat("failures", c->failures);
+}
+
+/**
+ * Page allocator counters and free blocks of
+ * each order of a node.
+ */
+static void dump_node_stats(int n)
+{
+    struct buddy_allocator *pa = &nodes[n].pa;
+    int i, largest, printed = 0;
+
+    putstr64("node ");
+    puti64(n);
+    put_stat("domain", nodes[n].domain);
+    put_stat("managed", pa->managed_frames);
+    put_stat("free", buddy_free_frames(pa));
+    put_stat("used", pa->used_frames);
+    put_stat("peak", pa->peak_used_frames);
+    newline64();
+    putstr64("      ");
+    put_stat("allocs", pa->allocs);
+    put_stat("frees", pa->frees);
+    put_stat("failures", pa->failures);
+    newline64();
+
+    /* Fragmentation: free blocks of each order */
+    putstr64("free blocks (order:count):");
+    for (i = 0; i != BUDDY_ORDERS; ++i)
     {
-        panic64("page_allocator_init");
+        if (!pa->free_count[i])
+            continue;
+        if (printed && !(printed % 8))
+            newline64();
+        putstr64(" ");
+        puti64(i);
+        putstr64(":");
+        putlu64(pa->free_count[i]);
+        ++printed;
     }
-    printline64("DONE!");
-    // init kalloc/kfree subsystem
-    putstr64("Initializing kalloc/kfree... ");
-    void *kdyn = kalloc_page();
-    if (!kdyn)
+    newline64();
+    largest = buddy_largest_free_order(pa);
+    putstr64("largest free block: ");
+    if (largest < 0)
+        putstr64("none");
+    else
+    {
+        putlu64((page_size << largest) >> 10);
+        putstr64(" KB");
+    }
+    newline64();
+}
+
+/**
+ * Locks are not taken: this runs from panic64, maybe
+ * with page_lock held. Numbers may be off by a few
+ * operations if other processors are allocating.
+ */
+void memory_dump_stats()
+{
+    int i;
+    unsigned long cached = zero_pool_count + scrub_count;
+
+    for (i = 0; i != MAX_CPUS; ++i)
+    {
+        cached += magazines[i].count;
+    }
+
+    printline64("-- memory statistics --");
+    for (i = 0; i != node_count; ++i)
+    {
+        dump_node_stats(i);
+    }
+    putstr64("pages:");
+    put_stat("cached", cached);
+    put_stat("kalloc_page failures", kalloc_page_failures);
+    newline64();
+
+    put_counters("slab:", &slab_counters);
+    newline64();
+    for (i = 0; i != KALLOC_CLASSES; ++i)
     {
-        panic64("kalloc_page");
+        if (!kalloc_caches[i])
+            continue;
+        putstr64(" ");
+        putstr64(kalloc_caches[i]->name);
+        putstr64("=");
+        putlu64(kalloc_caches[i]->active_objects);
+        putstr64("/");
+        putlu64(kalloc_caches[i]->slab_count);
     }
+    newline64();
+
+    put_counters("mm_malloc:", &mm_counters);
+    put_stat("live", mm_counters.allocs - mm_counters.frees);
+    put_stat("region", kdyn_end - kdyn_begin);
+    newline64();
+
+    putstr64("heap:");
+    put_stat("allocs", kheap.allocs);
+    put_stat("frees", kheap.frees);
+    put_stat("failures", kheap.failures);
+    put_stat("used", kheap.used_bytes);
+    put_stat("peak", kheap.peak_used_bytes);
+    newline64();
+    putstr64("     ");
+    put_stat("chunks", kheap.chunk_bytes);
+    put_stat("peak", kheap.peak_chunk_bytes);
+    put_stat("largest free", heap_largest_free(&kheap));
+    put_stat("kalloc failures", kalloc_failures);
+    newline64();
+}
+
+
+/**
+ * Register [start, end) as usable RAM, keeping only
+ * whole pages between "floor" and the end of the
+ * identity mapping. Overlapping or adjacent ranges
+ * are merged.
+ */
+static void add_usable_region(unsigned long start, unsigned long end, unsigned long floor)
+{
+    int i, j;
+
+    if (start < floor)
+        start = floor;
+    if (end > identity_mapped_limit)
+        end = identity_mapped_limit;
+    start = (start + page_size - 1) & ~(page_size - 1);
+    end &= ~(page_size - 1);
+    if (end <= start)
+        return;
+
+    /* Find insertion point */
+    for (i = 0; i != usable_region_count; ++i)
     {
-        unsigned long check = (unsigned long)kdyn;
-        for (int i = 1; i != pages_used_for_synamic_memory; ++i)
+        if (start <= usable_regions[i].end && usable_regions[i].start <= end)
         {
-            if (check + page_size != (unsigned long)kalloc_page())
+            /* Merge with existing region and with the following ones */
+            if (start < usable_regions[i].start)
+                usable_regions[i].start = start;
+            if (end > usable_regions[i].end)
+                usable_regions[i].end = end;
+            while (i + 1 != usable_region_count && usable_regions[i+1].start <= usable_regions[i].end)
             {
-                panic64("Misaligned pages!");
+                if (usable_regions[i+1].end > usable_regions[i].end)
+                    usable_regions[i].end = usable_regions[i+1].end;
+                for (j = i + 1; j + 1 != usable_region_count; ++j)
+                    usable_regions[j] = usable_regions[j+1];
+                --usable_region_count;
             }
-            check += page_size;
+            return;
         }
+        if (end < usable_regions[i].start)
+            break;
     }
-    if (mm_init_memory_manager(kdyn, page_size*pages_used_for_synamic_memory))
+    if (usable_region_count == MAX_MEMORY_REGIONS)
     {
-        panic64("mm_init_memory_manager");
+        log_warning("Too many memory regions, some RAM ignored!");
+        return;
+    }
+    for (j = usable_region_count; j != i; --j)
+        usable_regions[j] = usable_regions[j-1];
+    usable_regions[i] = (struct memory_region){ .start = start, .end = end };
+    ++usable_region_count;
+}
+
+/**
+ * Collect usable RAM from the multiboot info.
+ * The memory map is preferred, if not available
+ * fall back to the upper memory size.
+ */
+static void discover_memory(struct multiboot_info *mi, unsigned long floor)
+{
+    if (!mi)
+    {
+        panic64("No multiboot info!");
+    }
+    if (mi->flags & MULTIBOOT_FLAG_6)
+    {
+        unsigned long ptr = mi->mmap_addr;
+        const unsigned long end = ptr + mi->mmap_length;
+        while (ptr < end)
+        {
+            struct multiboot_mmap_entry *entry = (struct multiboot_mmap_entry *)ptr;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE)
+            {
+                add_usable_region(entry->base_addr, entry->base_addr + entry->length, floor);
+            }
+            ptr += entry->size + sizeof(entry->size);
+        }
+    }
+    else if (mi->flags & MULTIBOOT_FLAG_0)
+    {
+        /* mem_upper starts at 1MB and is in KB */
+        add_usable_region(1UL << 20, (1UL << 20) + ((unsigned long)mi->mem_upper << 10), floor);
+    }
+    else
+    {
+        panic64("No memory info!");
     }
-    printline64("DONE!");
 }
 
+/**
+ * Node index of an ACPI proximity domain, a new
+ * node is created the first time a domain is seen.
+ * Domains beyond MAX_NUMA_NODES share node 0.
+ */
+static int node_of_domain(unsigned int domain)
+{
+    int i;
+    for (i = 0; i != node_count; ++i)
+    {
+        if (nodes[i].domain == domain)
+            return i;
+    }
+    if (node_count == MAX_NUMA_NODES)
+        return 0;
+    nodes[node_count].domain = domain;
+    return node_count++;
+}
+
+/**
+ * Split the usable regions at the boundaries of the
+ * SRAT memory ranges and assign each piece to the
+ * node of its range. Memory outside every range
+ * goes to node 0.
+ */
+static void split_by_affinity(struct acpi_srat_info *srat)
+{
+    static struct memory_region split[MAX_MEMORY_REGIONS];
+    int i, j, count = 0;
+
+    /* Nodes are numbered in SRAT order */
+    node_count = 0;
+    for (i = 0; i != srat->memory_count; ++i)
+    {
+        node_of_domain(srat->memory[i].domain);
+    }
+
+    for (i = 0; i != usable_region_count; ++i)
+    {
+        unsigned long start = usable_regions[i].start;
+        while (start < usable_regions[i].end)
+        {
+            unsigned long end = usable_regions[i].end;
+            int node = 0;
+            for (j = 0; j != srat->memory_count; ++j)
+            {
+                struct acpi_memory_affinity *m = &srat->memory[j];
+                if (m->start <= start && start < m->end)
+                {
+                    node = node_of_domain(m->domain);
+                    if (m->end < end)
+                        end = m->end;
+                    break;
+                }
+                /* Stop where the next range begins */
+                if (start < m->start && m->start < end)
+                    end = m->start;
+            }
+            if (count == MAX_MEMORY_REGIONS)
+            {
+                log_warning("Too many memory regions, some RAM ignored!");
+                break;
+            }
+            split[count++] = (struct memory_region){ .start = start, .end = end, .node = node };
+            start = end;
+        }
+    }
+    for (i = 0; i != count; ++i)
+    {
+        usable_regions[i] = split[i];
+    }
+    usable_region_count = count;
+}
+
+/**
+ * Find the node of the bootstrap processor from its
+ * initial APIC id, CPUID.01H:EBX[31:24]. Application
+ * processors must do the same when they are started.
+ */
+static void assign_cpu_nodes(struct acpi_srat_info *srat)
+{
+    unsigned int regs[4], apic_id;
+    int i;
+
+    so_cpuid(1, 0, regs);
+    apic_id = regs[1] >> 24;
+    for (i = 0; i != srat->cpu_count; ++i)
+    {
+        if (srat->cpus[i].apic_id == apic_id)
+        {
+            cpu_node[smp_processor_id()] = node_of_domain(srat->cpus[i].domain);
+            return;
+        }
+    }
+}
+
+/**
+ * Create the page allocator of every node. Its frame
+ * metadata is taken from the first region of the node
+ * big enough, or from any region if there is none.
+ * All metadata is carved before any region is given
+ * to an allocator.
+ * Return the number of usable bytes.
+ */
+static unsigned long init_nodes()
+{
+    static unsigned char *metadata[MAX_NUMA_NODES];
+    static unsigned long lowest[MAX_NUMA_NODES], highest[MAX_NUMA_NODES];
+    unsigned long metadata_size, total = 0;
+    int n, i, pass;
+
+    for (n = 0; n != node_count; ++n)
+    {
+        lowest[n] = ~0UL;
+        highest[n] = 0;
+        for (i = 0; i != usable_region_count; ++i)
+        {
+            if (usable_regions[i].node != n)
+                continue;
+            if (usable_regions[i].start < lowest[n])
+                lowest[n] = usable_regions[i].start;
+            if (usable_regions[i].end > highest[n])
+                highest[n] = usable_regions[i].end;
+        }
+        /* Node without memory, its allocator stays empty */
+        if (highest[n] <= lowest[n])
+            continue;
+
+        metadata_size = ((highest[n] - lowest[n]) / page_size + page_size - 1) & ~(page_size - 1);
+        for (pass = 0; pass != 2 && !metadata[n]; ++pass)
+        {
+            for (i = 0; i != usable_region_count; ++i)
+            {
+                if (pass == 0 && usable_regions[i].node != n)
+                    continue;
+                if (usable_regions[i].end - usable_regions[i].start > metadata_size)
+                {
+                    metadata[n] = (unsigned char *)usable_regions[i].start;
+                    usable_regions[i].start += metadata_size;
+                    break;
+                }
+            }
+        }
+        if (!metadata[n])
+        {
+            panic64("No room for frame metadata!");
+        }
+    }
+
+    for (n = 0; n != node_count; ++n)
+    {
+        if (!metadata[n])
+            continue;
+        if (buddy_init(&nodes[n].pa, (void *)lowest[n], (highest[n] - lowest[n]) / page_size, metadata[n]))
+        {
+            panic64("buddy_init");
+        }
+    }
+    for (i = 0; i != usable_region_count; ++i)
+    {
+        struct memory_region *r = &usable_regions[i];
+        if (buddy_add_region(&nodes[r->node].pa, (void *)r->start, (void *)r->end))
+        {
+            panic64("buddy_add_region");
+        }
+        total += r->end - r->start;
+    }
+    return total;
+}
+
+void memory_init()
+{
+    struct multiboot_info *mi = (struct multiboot_info *)(unsigned long)multiboot_info_structure;
+    // everything before the heap base is used by the kernel image
+    const unsigned long kernel_end = (unsigned long)aling_to_page(&_heap_base);
+    static struct acpi_srat_info srat;
+    unsigned long total;
+    int i;
+
+    // init paging subsystem
+    /**
+     * Free frames are linked through their own memory,
+     * so only RAM reported by the bootloader is used.
+     * The map must be copied before any frame is freed
+     * because it may lie in usable memory.
+     */
+    discover_memory(mi, kernel_end);
+    if (!usable_region_count)
+    {
+        panic64("No usable memory!");
+    }
+    /* Without a SRAT everything is node 0 */
+    if (!acpi_read_srat(&srat, identity_mapped_limit))
+    {
+        split_by_affinity(&srat);
+        assign_cpu_nodes(&srat);
+    }
+    total = init_nodes();
+    log_info("Usable memory: %luKB in %d regions, %d NUMA nodes",
+        total >> 10, usable_region_count, node_count);
+
+    // init kalloc/kfree subsystem
+    void *kdyn = kalloc_pages(dynamic_memory_order);
+    if (!kdyn)
+    {
+        panic64("kalloc_pages");
+    }
+    if (mm_init_memory_manager(kdyn, page_size << dynamic_memory_order))
+    {
+        panic64("mm_init_memory_manager");
+    }
+    kdyn_begin = kdyn;
+    kdyn_end = kdyn + (page_size << dynamic_memory_order);
+    heap_init(&kheap);
+    for (i = 0; i != KALLOC_CLASSES; ++i)
+    {
+        kalloc_caches[i] = kmem_cache_create(kalloc_names[i], kalloc_sizes[i], 0, (void*)0);
+        if (!kalloc_caches[i])
+        {
+            panic64("kmem_cache_create");
+        }
+    }
+    log_info("kalloc/kfree initialized");
+}
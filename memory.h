@@ -16,11 +16,86 @@ void memory_init();
  */
 void *kalloc_page();
 
+/**
+ * Maximum number of NUMA nodes, each with
+ * its own page allocator.
+ */
+#define MAX_NUMA_NODES 8
+
+/**
+ * Number of NUMA nodes found in the ACPI SRAT,
+ * 1 if there is none.
+ */
+int numa_node_count();
+
+/**
+ * Node of the processor executing the caller.
+ */
+int numa_local_node();
+
+/**
+ * Allocate a page from the given node, or from
+ * another node if it has no free memory.
+ * kalloc_page allocates from the local node.
+ */
+void *kalloc_page_node(int node);
+
+/**
+ * Allocate a page filled with zeroes.
+ * Served from a pool of cleared pages when
+ * possible, so the page is not cleared on
+ * the allocation path.
+ */
+void *kalloc_page_zeroed();
+
 /**
  * Deallocate page.
+ * The page may be kept and cleared later to
+ * refill the pool used by kalloc_page_zeroed.
  */
 void kfree_page(void *page);
 
+/**
+ * To be called when the kernel has nothing
+ * better to do: clear freed pages and refill
+ * the pool of zeroed pages.
+ */
+void memory_idle();
+
+/**
+ * Allocate 2^order contiguous pages, aligned
+ * to their size.
+ */
+void *kalloc_pages(int order);
+
+/**
+ * Deallocate pages obtained with kalloc_pages
+ * with the same order.
+ */
+void kfree_pages(void *ptr, int order);
+
+/**
+ * Size classes of kalloc_huge, the value is
+ * the order of the block in pages.
+ */
+#define HUGE_PAGE_2MB 9
+#define HUGE_PAGE_1GB 18
+
+/**
+ * Allocate a huge page of the given size class,
+ * aligned to its size so that it can be mapped
+ * by a single 2MB or 1GB page table entry.
+ * Return a null pointer if the size class is not
+ * valid or no such block is free.
+ */
+void *kalloc_huge(int size_class);
+
+/**
+ * Deallocate a huge page obtained with kalloc_huge
+ * with the same size class.
+ */
+void kfree_huge(void *ptr, int size_class);
+
 /**
  * Allocate kernel dynamic memory.
  */
@@ -31,4 +106,19 @@ void *kalloc(unsigned long size);
  */
 void kfree(void *ptr);
 
+/**
+ * Highest number of bytes ever held by the
+ * kalloc heap, including the initial region.
+ */
+unsigned long kalloc_high_water_mark();
+
+/**
+ * Print the counters of the page allocator and of
+ * the kalloc backends: allocations, frees, failures,
+ * memory in use and its peak, and the free blocks of
+ * each order to measure fragmentation.
+ * Safe to call from panic64.
+ */
+void memory_dump_stats();
+
 #endif
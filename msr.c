@@ -55,6 +55,11 @@ long msr_read_ia32_pat()
     return msr_read(MSR_IA32_PAT);
 }
 
+void msr_write_ia32_pat(long value)
+{
+    msr_write(MSR_IA32_PAT, value);
+}
+
 long msr_read_ia32_ia32_perf_global_ctrl()
 {
     return msr_read(MSR_IA32_PERF_GLOBAL_CTRL);
@@ -11,6 +11,7 @@ long msr_read_ia32_sysenter_eip();
 long msr_read_ia32_debugctl();
 
 long msr_read_ia32_pat();
+void msr_write_ia32_pat(long value);
 
 long msr_read_ia32_ia32_perf_global_ctrl();
 
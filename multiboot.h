@@ -54,21 +54,66 @@ struct multiboot_info
 #define MULTIBOOT_FLAG_11 (1 << 11)
     u32 vbe_control_info;
     u32 vbe_mode_info;
-    u32 vbe_mode;
-    u32 vbe_interface_seg;
-    u32 vbe_interface_off;
-    u32 vbe_interface_len;
+    u16 vbe_mode;
+    u16 vbe_interface_seg;
+    u16 vbe_interface_off;
+    u16 vbe_interface_len;
 
 #define MULTIBOOT_FLAG_12 (1 << 12)
-    u32 framebuffer_addr;
+    u64 framebuffer_addr;
+    /* Bytes per line */
     u32 framebuffer_pitch;
+    /* Pixels, or characters in text mode */
     u32 framebuffer_width;
     u32 framebuffer_height;
-    u32 framebuffer_bpp;
-    u32 framebuffer_type;
-    u32 color_info;
+    u8 framebuffer_bpp;
+#define MULTIBOOT_FRAMEBUFFER_INDEXED 0
+#define MULTIBOOT_FRAMEBUFFER_RGB 1
+#define MULTIBOOT_FRAMEBUFFER_TEXT 2
+    u8 framebuffer_type;
+    union
+    {
+        /**
+         * When framebuffer_type is INDEXED: palette of
+         * 3 bytes entries (red, green, blue). Packed,
+         * the address is at offset 110.
+         */
+        struct __attribute__ ((packed))
+        {
+            u32 framebuffer_palette_addr;
+            u16 framebuffer_palette_num_colors;
+        };
+        /* Layout of the pixels when framebuffer_type is RGB */
+        struct
+        {
+            u8 framebuffer_red_field_position;
+            u8 framebuffer_red_mask_size;
+            u8 framebuffer_green_field_position;
+            u8 framebuffer_green_mask_size;
+            u8 framebuffer_blue_field_position;
+            u8 framebuffer_blue_mask_size;
+        };
+    };
 };
 
+/**
+ * Entries of the buffer referenced by mmap_addr.
+ * The size field does not count itself, so the next
+ * entry starts (size + 4) bytes after the current one.
+ *
+ * See:
+ *  https://www.gnu.org/software/grub/manual/multiboot/multiboot.html#Boot-information-format
+ */
+struct multiboot_mmap_entry
+{
+    u32 size;
+    u64 base_addr;
+    u64 length;
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+#define MULTIBOOT_MEMORY_RESERVED  2
+    u32 type;
+} __attribute__((packed));
+
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "serial64.h"
+#include "io64.h"
+#include "interrupt/interrupt64.h"
+#include "interrupt/interrupt64_handlers.h"
+#include "interrupt/pic64.h"
+
+#define COM1 0x3F8
+
+/**
+ * Registers, offsets from COM1
+ */
+#define UART_DATA       0   /* THR when written, DLL with DLAB */
+#define UART_IER        1   /* Interrupt enable, DLM with DLAB */
+#define UART_IIR        2   /* Interrupt identification when read */
+#define UART_FCR        2   /* FIFO control when written */
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
+#define UART_SCRATCH    7
+
+#define IER_THRE        0x02
+#define FCR_ENABLE      0x01
+#define FCR_CLEAR_RX    0x02
+#define FCR_CLEAR_TX    0x04
+#define LCR_8N1         0x03
+#define LCR_DLAB        0x80
+/* OUT2 connects the interrupt line to the PIC */
+#define MCR_DTR_RTS_OUT2 0x0B
+#define LSR_THRE        0x20
+/* Holding and shift registers both empty */
+#define LSR_TEMT        0x40
+#define IIR_NO_INTERRUPT 0x01
+
+/* 115200 / divisor baud */
+#define BAUD_DIVISOR    1
+#define FIFO_SIZE       16
+
+static int present;
+static char ring[SERIAL_RING_SIZE];
+/**
+ * Written from head, sent from tail, empty when
+ * equal. Both only grow, the index is modulo
+ * SERIAL_RING_SIZE. A slot is written before head
+ * is published (release) and read after loading
+ * it (acquire), tail likewise the other way.
+ */
+static volatile unsigned long head, tail;
+/* The THRE interrupt will send the next burst */
+static volatile int transmitting;
+
+static inline unsigned char uart_read(int reg)
+{
+    return inputb64(COM1 + reg);
+}
+
+static inline void uart_write(int reg, unsigned char value)
+{
+    outputb64(COM1 + reg, value);
+}
+
+int serial_init64()
+{
+    /* A missing UART reads as 0xff */
+    uart_write(UART_SCRATCH, 0x5a);
+    if (uart_read(UART_SCRATCH) != 0x5a)
+        return 1;
+
+    uart_write(UART_IER, 0);
+    uart_write(UART_LCR, LCR_DLAB);
+    uart_write(UART_DATA, BAUD_DIVISOR & 0xff);
+    uart_write(UART_IER, BAUD_DIVISOR >> 8);
+    uart_write(UART_LCR, LCR_8N1);
+    uart_write(UART_FCR, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+    uart_write(UART_MCR, MCR_DTR_RTS_OUT2);
+
+    pic_remap64();
+    set_interrupt_handler(PIC_VECTOR_BASE + IRQ_COM1, handle_com1);
+    pic_unmask64(IRQ_COM1);
+    present = 1;
+    return 0;
+}
+
+/**
+ * Fill the transmit FIFO, which must be empty.
+ * Interrupts must be disabled.
+ */
+static void send_burst()
+{
+    const unsigned long h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    unsigned long t = tail;
+    int i;
+
+    for (i = 0; i != FIFO_SIZE && t != h; ++i)
+    {
+        uart_write(UART_DATA, ring[t++ % SERIAL_RING_SIZE]);
+    }
+    __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+}
+
+/**
+ * Send everything by polling, one look at
+ * LSR every FIFO_SIZE bytes.
+ * Interrupts must be disabled.
+ */
+static void drain()
+{
+    while (tail != head)
+    {
+        while (!(uart_read(UART_LSR) & LSR_THRE))
+            ;
+        send_burst();
+    }
+}
+
+static void queue(char c)
+{
+    const unsigned long h = head;
+
+    if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == SERIAL_RING_SIZE)
+    {
+        /* Full, make room */
+        unsigned long flags = irq_save64();
+        drain();
+        irq_restore64(flags);
+    }
+    ring[h % SERIAL_RING_SIZE] = c;
+    /* The interrupt may send the slot as soon as it sees head */
+    __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+void serial_putc64(char c)
+{
+    if (!present)
+        return;
+    if (c == '\n')
+        queue('\r');
+    queue(c);
+}
+
+void serial_write64(const char *str, int len)
+{
+    int i;
+    for (i = 0; i != len; ++i)
+    {
+        serial_putc64(str[i]);
+    }
+}
+
+void serial_kick64()
+{
+    unsigned long flags;
+
+    if (!present)
+        return;
+    flags = irq_save64();
+    if (!IRQ_ENABLED(flags))
+    {
+        /* No interrupt would come */
+        drain();
+    }
+    else if (!transmitting && tail != head)
+    {
+        /**
+         * Bursts go out when THR is empty, the
+         * interrupt signals when it is again.
+         */
+        while (!(uart_read(UART_LSR) & LSR_THRE))
+            ;
+        send_burst();
+        transmitting = 1;
+        uart_write(UART_IER, IER_THRE);
+    }
+    irq_restore64(flags);
+}
+
+void serial_flush64()
+{
+    unsigned long flags;
+
+    if (!present)
+        return;
+    flags = irq_save64();
+    drain();
+    while (!(uart_read(UART_LSR) & LSR_TEMT))
+        ;
+    irq_restore64(flags);
+}
+
+void serial_interrupt64()
+{
+    /* Reading IIR acknowledges the THRE interrupt */
+    if (!(uart_read(UART_IIR) & IIR_NO_INTERRUPT) && (uart_read(UART_LSR) & LSR_THRE))
+    {
+        if (tail != __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+            send_burst();
+        else
+        {
+            uart_write(UART_IER, 0);
+            transmitting = 0;
+        }
+    }
+    pic_eoi64(IRQ_COM1);
+}
@@ -0,0 +1,59 @@
+/**
+ * Console on the first serial port (COM1), a
+ * 16550 UART, so that emulators and test rigs
+ * can capture the output (qemu -serial stdio).
+ *
+ * Characters are queued in a ring and sent 16
+ * at a time: when the transmitter holding register
+ * is empty the whole FIFO is free, so a burst needs
+ * a single look at the line status register.
+ * With interrupts enabled the next burst is sent
+ * by the THRE interrupt (IRQ 4), otherwise (VM
+ * exit handlers, panics) right away by polling.
+ *
+ * See:
+ *  https://wiki.osdev.org/Serial_Ports
+ *  http://www.byterunner.com/16550.html
+ */
+#ifndef SERIAL64
+#define SERIAL64
+
+/**
+ * Bytes queued before the writer waits
+ * for the UART
+ */
+#define SERIAL_RING_SIZE 4096
+
+/**
+ * Program COM1 (115200 8N1, FIFOs enabled) and
+ * route IRQ 4 to it. Interrupts are not enabled.
+ *
+ * Return 0 on success, nonzero if there is no UART:
+ * the other functions then do nothing.
+ */
+int serial_init64();
+
+/**
+ * Queue characters, '\n' is sent as "\r\n".
+ * Nothing is sent until serial_kick64.
+ */
+void serial_putc64(char c);
+void serial_write64(const char *str, int len);
+
+/**
+ * Start sending the queued characters.
+ */
+void serial_kick64();
+
+/**
+ * Send everything queued before returning,
+ * for panics.
+ */
+void serial_flush64();
+
+/**
+ * IRQ 4 handler, see interrupt64_handlers.S
+ */
+void serial_interrupt64();
+
+#endif
@@ -0,0 +1,267 @@
+#include "slab.h"
+#include "memory.h"
+
+/**
+ * Used to recognise slab headers
+ */
+#define SLAB_MAGIC 0x51ab51ab51ab51abUL
+
+/**
+ * Objects indices are stored in one byte.
+ */
+#define SLAB_MAX_OBJECTS 255
+
+/**
+ * Placed at the beginning of each slab, it is
+ * followed by the stack of free objects indices.
+ */
+struct slab
+{
+    unsigned long magic;
+    struct kmem_cache *cache;
+    struct slab *next;
+    struct slab *prev;
+    /* One bit for each allocated object, to catch double frees */
+    unsigned long used[(SLAB_MAX_OBJECTS + 63) / 64];
+    unsigned short in_use;
+    /* Number of valid entries in free_stack */
+    unsigned short free_top;
+    unsigned char free_stack[];
+};
+
+/**
+ * Cache used to allocate struct kmem_cache.
+ * Initialised by the first kmem_cache_create.
+ */
+static struct kmem_cache cache_cache;
+
+static inline unsigned long align_up(unsigned long n, unsigned long align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+static inline struct slab *slab_of(void *obj)
+{
+    return (struct slab *)((unsigned long)obj & ~(SLAB_SIZE - 1));
+}
+
+static void slab_list_push(struct slab **head, struct slab *s)
+{
+    s->prev = (void*)0;
+    s->next = *head;
+    if (s->next)
+        s->next->prev = s;
+    *head = s;
+}
+
+static void slab_list_remove(struct slab **head, struct slab *s)
+{
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        *head = s->next;
+    if (s->next)
+        s->next->prev = s->prev;
+}
+
+/**
+ * Return the list the slab belongs to given
+ * the number of allocated objects.
+ */
+static struct slab **slab_list_of(struct kmem_cache *cache, unsigned long in_use)
+{
+    if (in_use == 0)
+        return &cache->empty;
+    if (in_use == cache->objects_per_slab)
+        return &cache->full;
+    return &cache->partial;
+}
+
+static int cache_setup(struct kmem_cache *cache, const char *name, unsigned long size, unsigned long align, void (*ctor)(void *))
+{
+    unsigned long n;
+
+    if (!align)
+        align = SLAB_CACHE_LINE;
+    /* Must be a power of two */
+    if (align & (align - 1))
+        return 1;
+    if (!size || size > SLAB_MAX_OBJECT_SIZE)
+        return 1;
+
+    size = align_up(size, align);
+    /* Fit as many objects as possible after the header */
+    n = (SLAB_SIZE - sizeof(struct slab)) / size;
+    if (n > SLAB_MAX_OBJECTS)
+        n = SLAB_MAX_OBJECTS;
+    while (n && align_up(sizeof(struct slab) + n, align) + n * size > SLAB_SIZE)
+        --n;
+    if (!n)
+        return 1;
+
+    cache->name = name;
+    cache->object_size = size;
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->first_object = align_up(sizeof(struct slab) + n, align);
+    cache->objects_per_slab = n;
+    cache->partial = (void*)0;
+    cache->full = (void*)0;
+    cache->empty = (void*)0;
+    cache->slab_count = 0;
+    cache->active_objects = 0;
+    return 0;
+}
+
+static struct slab *slab_create(struct kmem_cache *cache)
+{
+    struct slab *s = kalloc_pages(SLAB_ORDER);
+    unsigned long i;
+
+    if (!s)
+        return (void*)0;
+
+    s->magic = SLAB_MAGIC;
+    s->cache = cache;
+    s->in_use = 0;
+    s->free_top = cache->objects_per_slab;
+    for (i = 0; i != sizeof(s->used)/sizeof(*s->used); ++i)
+        s->used[i] = 0;
+    /* Lowest indices on top, objects are handed out in address order */
+    for (i = 0; i != cache->objects_per_slab; ++i)
+    {
+        s->free_stack[i] = cache->objects_per_slab - 1 - i;
+        if (cache->ctor)
+            cache->ctor((char *)s + cache->first_object + i * cache->object_size);
+    }
+    ++cache->slab_count;
+    return s;
+}
+
+static void slab_destroy(struct kmem_cache *cache, struct slab *s)
+{
+    s->magic = 0;
+    --cache->slab_count;
+    kfree_pages(s, SLAB_ORDER);
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, unsigned long size, unsigned long align, void (*ctor)(void *))
+{
+    struct kmem_cache *cache;
+
+    if (!cache_cache.objects_per_slab)
+    {
+        if (cache_setup(&cache_cache, "kmem_cache", sizeof(struct kmem_cache), 0, (void*)0))
+            return (void*)0;
+    }
+    cache = kmem_cache_alloc(&cache_cache);
+    if (!cache)
+        return (void*)0;
+    if (cache_setup(cache, name, size, align, ctor))
+    {
+        kmem_cache_free(&cache_cache, cache);
+        return (void*)0;
+    }
+    return cache;
+}
+
+int kmem_cache_destroy(struct kmem_cache *cache)
+{
+    if (!cache || cache->active_objects)
+        return 1;
+    while (cache->empty)
+    {
+        struct slab *s = cache->empty;
+        slab_list_remove(&cache->empty, s);
+        slab_destroy(cache, s);
+    }
+    return kmem_cache_free(&cache_cache, cache);
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+    struct slab *s;
+    unsigned long index;
+
+    if (!cache)
+        return (void*)0;
+
+    if (cache->partial)
+    {
+        s = cache->partial;
+    }
+    else
+    {
+        if (!cache->empty)
+        {
+            s = slab_create(cache);
+            if (!s)
+                return (void*)0;
+            slab_list_push(&cache->empty, s);
+        }
+        s = cache->empty;
+    }
+
+    slab_list_remove(slab_list_of(cache, s->in_use), s);
+    index = s->free_stack[--s->free_top];
+    s->used[index / 64] |= 1UL << (index % 64);
+    ++s->in_use;
+    slab_list_push(slab_list_of(cache, s->in_use), s);
+    ++cache->active_objects;
+
+    return (char *)s + cache->first_object + index * cache->object_size;
+}
+
+int kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+    struct slab *s = slab_of(obj);
+    unsigned long offset, index;
+
+    if (!cache || !obj || s->magic != SLAB_MAGIC || s->cache != cache)
+        return 1;
+    offset = (unsigned long)obj - (unsigned long)s;
+    if (offset < cache->first_object)
+        return 1;
+    offset -= cache->first_object;
+    index = offset / cache->object_size;
+    if (offset % cache->object_size || index >= cache->objects_per_slab)
+        return 1;
+    /* Double free? */
+    if (!(s->used[index / 64] & (1UL << (index % 64))))
+        return 1;
+
+    slab_list_remove(slab_list_of(cache, s->in_use), s);
+    s->used[index / 64] &= ~(1UL << (index % 64));
+    s->free_stack[s->free_top++] = index;
+    --s->in_use;
+    --cache->active_objects;
+
+    /* Keep at most one empty slab for future allocations */
+    if (!s->in_use && cache->empty)
+    {
+        slab_destroy(cache, s);
+    }
+    else
+    {
+        slab_list_push(slab_list_of(cache, s->in_use), s);
+    }
+    return 0;
+}
+
+struct kmem_cache *kmem_cache_of(void *obj)
+{
+    struct slab *s = slab_of(obj);
+
+    if (!obj || s->magic != SLAB_MAGIC)
+        return (void*)0;
+    return s->cache;
+}
+
+int kmem_free(void *obj)
+{
+    struct slab *s = slab_of(obj);
+
+    if (!obj || s->magic != SLAB_MAGIC)
+        return 1;
+    return kmem_cache_free(s->cache, obj);
+}
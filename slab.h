@@ -0,0 +1,108 @@
+/**
+ * Object caches for fixed size kernel objects.
+ *
+ * Every cache owns a set of slabs, blocks of
+ * 2^SLAB_ORDER pages obtained with kalloc_pages and
+ * cut into equally sized objects. Allocation and
+ * deallocation never scan: free objects of each slab
+ * are kept in a stack and slabs with free objects are
+ * kept in a dedicated list.
+ *
+ * Inspired by:
+ *  Jeff Bonwick, "The Slab Allocator: An Object-Caching
+ *  Kernel Memory Allocator" (USENIX 1994)
+ */
+
+#ifndef SLAB
+#define SLAB
+
+/**
+ * Slabs are 16KB, naturally aligned so that the slab
+ * of an object is found masking its address.
+ */
+#define SLAB_ORDER 2
+#define SLAB_SIZE (4096UL << SLAB_ORDER)
+
+/**
+ * Default object alignment, one cache line.
+ */
+#define SLAB_CACHE_LINE 64
+
+/**
+ * Biggest object a cache can hold, a slab must
+ * contain at least 4 of them.
+ */
+#define SLAB_MAX_OBJECT_SIZE (SLAB_SIZE / 4 - SLAB_CACHE_LINE)
+
+struct slab;
+
+struct kmem_cache
+{
+    const char *name;
+    /* Size of each object, including padding */
+    unsigned long object_size;
+    unsigned long align;
+    /* Called once on each object when its slab is created */
+    void (*ctor)(void *);
+    /* Offset of the first object from the slab beginning */
+    unsigned long first_object;
+    unsigned long objects_per_slab;
+    /* Slabs with some free objects */
+    struct slab *partial;
+    /* Slabs without free objects */
+    struct slab *full;
+    /* Slabs without allocated objects */
+    struct slab *empty;
+    unsigned long slab_count;
+    unsigned long active_objects;
+};
+
+/**
+ * Create a new cache of objects of the given size.
+ * If align is 0 objects are aligned to a cache line.
+ * ctor may be a null pointer.
+ *
+ * Return a null pointer on failure.
+ */
+struct kmem_cache *kmem_cache_create(const char *name, unsigned long size, unsigned long align, void (*ctor)(void *));
+
+/**
+ * Destroy an empty cache.
+ *
+ * Return 0 on success, nonzero if some object
+ * is still allocated.
+ */
+int kmem_cache_destroy(struct kmem_cache *cache);
+
+/**
+ * Allocate an object from the cache.
+ *
+ * Return a null pointer if no memory is available.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+
+/**
+ * Return an object to its cache.
+ *
+ * Return 0 on success, nonzero if the pointer does
+ * not refer to an object allocated from the cache.
+ */
+int kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+/**
+ * Cache of the slab containing obj, found in O(1)
+ * masking its address, or a null pointer if that
+ * memory is not a slab. The object itself is not
+ * checked, see kmem_cache_free.
+ */
+struct kmem_cache *kmem_cache_of(void *obj);
+
+/**
+ * Return an object to the cache it was allocated
+ * from, which is found from the object address.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int kmem_free(void *obj);
+
+#endif
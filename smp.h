@@ -0,0 +1,35 @@
+/**
+ * Definitions shared by code keeping
+ * per-processor data.
+ */
+
+#ifndef SMP
+#define SMP
+
+/**
+ * Maximum number of logical processors
+ * the kernel keeps per-processor data for.
+ */
+#define MAX_CPUS 8
+
+/**
+ * Per-processor data is aligned to a cache
+ * line to avoid false sharing.
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Index of the processor executing the caller,
+ * in [0, MAX_CPUS).
+ *
+ * Only the bootstrap processor is started for
+ * now, so it is always 0. When application
+ * processors are brought up this must read an
+ * id stored in per-processor memory (GS base).
+ */
+static inline int smp_processor_id()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * Test-and-test-and-set spinlock.
+ *
+ * Built on the GCC __atomic builtins, see:
+ *  https://gcc.gnu.org/onlinedocs/gcc/_005f_005fatomic-Builtins.html
+ */
+
+#ifndef SPINLOCK
+#define SPINLOCK
+
+typedef volatile int spinlock_t;
+
+#define SPINLOCK_INIT 0
+
+static inline void spin_lock(spinlock_t *lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE))
+    {
+        /* Wait reading, to not steal the cache line to the owner */
+        while (*lock)
+            __builtin_ia32_pause();
+    }
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -54,4 +54,15 @@ long so_read_dr5();
 long so_read_dr6();
 long so_read_dr7();
 
+/**
+ * Execute CPUID, regs receives EAX, EBX, ECX
+ * and EDX in this order.
+ */
+void so_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]);
+
+/**
+ * Read the time stamp counter (RDTSC)
+ */
+unsigned long so_read_tsc();
+
 #endif
@@ -1,4 +1,24 @@
 #include "string64.h"
+#include "status_operations64.h"
+
+/**
+ * See Intel Manual Vol. 2
+ *  [CPUID—CPU Identification], leaf 07H
+ */
+#define CPUID_7_EBX_ERMS (1 << 9)
+#define CPUID_7_EDX_FSRM (1 << 4)
+
+/**
+ * Below this size REP MOVSB/STOSB is slower than
+ * REP MOVSQ/STOSQ when only ERMS is available.
+ */
+#define ERMS_THRESHOLD 128
+
+/**
+ * Used by string64.S, word copies until
+ * string64_init64 is called.
+ */
+unsigned long string64_movsb_threshold = ~0UL;
 
 /**
  * @brief Does char rapresent digit
@@ -60,6 +80,50 @@ int strlen64(const char *str)
     return len;
 }
 
+void string64_init64()
+{
+    unsigned int regs[4];
+
+    so_cpuid(0, 0, regs);
+    if (regs[0] < 7)
+        return;
+    so_cpuid(7, 0, regs);
+    /* Fast short REP MOVSB: fast at every size */
+    if (regs[3] & CPUID_7_EDX_FSRM)
+        string64_movsb_threshold = 0;
+    else if (regs[1] & CPUID_7_EBX_ERMS)
+        string64_movsb_threshold = ERMS_THRESHOLD;
+}
+
+/**
+ * @brief compare n bytes, skipping
+ *  equal words 8 bytes at a time
+ *
+ * @return the difference of the first
+ *  different bytes, 0 if all equal
+ */
+int memcmp64(const void *a, const void *b, unsigned long n)
+{
+    const unsigned char *p = (const unsigned char *)a;
+    const unsigned char *q = (const unsigned char *)b;
+
+    while (n >= sizeof(unsigned long)
+        && *(const unsigned long *)p == *(const unsigned long *)q)
+    {
+        p += sizeof(unsigned long);
+        q += sizeof(unsigned long);
+        n -= sizeof(unsigned long);
+    }
+    for (; n; ++p, ++q, --n)
+    {
+        if (*p != *q)
+            return *p - *q;
+    }
+    return 0;
+}
+
+int memcmp(const void *a, const void *b, unsigned long n) __attribute__ ((alias ("memcmp64")));
+
 /**
  * @brief return a pointer to a
  *  statically allocated buffer
@@ -256,3 +320,169 @@ int atoi64(const char* str)
 
     return negative ? -number : number;
 }
+
+/**
+ * Output of kvsnprintf64: characters past the
+ * end of the buffer are only counted.
+ */
+struct format_output
+{
+    char *buf;
+    int size;
+    int len;
+};
+
+static void format_putc(struct format_output *out, char c)
+{
+    if (out->len < out->size - 1)
+        out->buf[out->len] = c;
+    ++out->len;
+}
+
+static void format_pad(struct format_output *out, char c, int n)
+{
+    while (n-- > 0)
+        format_putc(out, c);
+}
+
+/**
+ * Print a number with its sign and prefix,
+ * padded to width.
+ */
+static void format_number(struct format_output *out, unsigned long n, int base, int upper,
+    const char *prefix, int min_digits, int width, int left, int zero)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[64];
+    int count = 0, prefix_len = strlen64(prefix), i;
+
+    do {
+        tmp[count++] = digits[n % base];
+        n /= base;
+    } while (n);
+    while (count < min_digits)
+        tmp[count++] = '0';
+
+    width -= count + prefix_len;
+    if (!left && !zero)
+        format_pad(out, ' ', width);
+    for (i = 0; i != prefix_len; ++i)
+        format_putc(out, prefix[i]);
+    if (!left && zero)
+        format_pad(out, '0', width);
+    while (count)
+        format_putc(out, tmp[--count]);
+    if (left)
+        format_pad(out, ' ', width);
+}
+
+int kvsnprintf64(char *buf, int size, const char *fmt, va_list ap)
+{
+    struct format_output out = { buf, size, 0 };
+
+    if (!fmt)
+        return -1;
+
+    for (; *fmt; ++fmt)
+    {
+        int left = 0, zero = 0, width = 0, is_long = 0;
+
+        if (*fmt != '%')
+        {
+            format_putc(&out, *fmt);
+            continue;
+        }
+
+        /* Flags, width and length */
+        for (;;)
+        {
+            ++fmt;
+            if (*fmt == '-')
+                left = 1;
+            else if (*fmt == '0')
+                zero = 1;
+            else
+                break;
+        }
+        while (isdigit64(*fmt))
+            width = width * 10 + (*fmt++ - '0');
+        while (*fmt == 'l')
+        {
+            is_long = 1;
+            ++fmt;
+        }
+
+        switch (*fmt)
+        {
+        case 'd':
+        case 'i':
+        {
+            long n = is_long ? va_arg(ap, long) : va_arg(ap, int);
+            /* Negate as unsigned, LONG_MIN has no positive */
+            format_number(&out, n < 0 ? -(unsigned long)n : (unsigned long)n, 10, 0,
+                n < 0 ? "-" : "", 1, width, left, zero);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        {
+            unsigned long n = is_long ? va_arg(ap, unsigned long) : va_arg(ap, unsigned);
+            format_number(&out, n, *fmt == 'u' ? 10 : 16, *fmt == 'X', "", 1, width, left, zero);
+            break;
+        }
+        case 'p':
+            format_number(&out, (unsigned long)va_arg(ap, void *), 16, 0, "0x", 16, width, left, 0);
+            break;
+        case 'c':
+            if (!left)
+                format_pad(&out, ' ', width - 1);
+            format_putc(&out, (char)va_arg(ap, int));
+            if (left)
+                format_pad(&out, ' ', width - 1);
+            break;
+        case 's':
+        {
+            const char *str = va_arg(ap, const char *);
+            int len;
+            if (!str)
+                str = "(null)";
+            len = strlen64(str);
+            if (!left)
+                format_pad(&out, ' ', width - len);
+            while (*str)
+                format_putc(&out, *str++);
+            if (left)
+                format_pad(&out, ' ', width - len);
+            break;
+        }
+        case '%':
+            format_putc(&out, '%');
+            break;
+        case '\0':
+            /* Lone % at the end */
+            --fmt;
+            break;
+        default:
+            /* Unknown conversion, print it as is */
+            format_putc(&out, '%');
+            format_putc(&out, *fmt);
+            break;
+        }
+    }
+
+    if (size > 0)
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    return out.len;
+}
+
+int ksnprintf64(char *buf, int size, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = kvsnprintf64(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
@@ -6,6 +6,8 @@
 #ifndef STRING64
 #define STRING64
 
+#include <stdarg.h>
+
 int isdigit64(char c);
 
 char *strcpy64(char *dst, const char *src);
@@ -13,6 +15,30 @@ char *strcat64(char *dst, const char *src);
 
 int strlen64(const char *str);
 
+/**
+ * @brief choose how the functions below copy,
+ *  from the CPUID ERMS and FSRM bits. Before it
+ *  is called they are correct, but slower.
+ */
+void string64_init64();
+
+/**
+ * @brief memory functions, see string64.S.
+ *  Also exported as memcpy, memset, memmove
+ *  and memcmp for the code gcc generates.
+ *
+ * memcpy64 and memset64 use REP MOVSB/STOSB
+ * when the CPU has fast strings (ERMS/FSRM),
+ * 64 bit REP MOVSQ/STOSQ otherwise.
+ *
+ * @return dst, or for memcmp64 the difference
+ *  of the first different bytes
+ */
+void *memcpy64(void *dst, const void *src, unsigned long n);
+void *memset64(void *dst, int c, unsigned long n);
+void *memmove64(void *dst, const void *src, unsigned long n);
+int memcmp64(const void *a, const void *b, unsigned long n);
+
 const char* itoa64(int n);
 const char* ltoa64(long n);
 const char* ultoa64(unsigned long n);
@@ -20,4 +46,22 @@ const char* hex64(unsigned long n);
 
 int atoi64(const char* str);
 
+/**
+ * @brief format into buf, at most size bytes
+ *  including the zero terminator.
+ *
+ * Conversions: %d %i %u %x %X %c %s %p %%,
+ * with the "l" length modifier, the "-" and "0"
+ * flags and a decimal width. %p prints 0x and
+ * 16 hex digits, like hex64.
+ *
+ * Unlike itoa64 and friends no static buffer is
+ * used: safe from interrupt and VM exit context.
+ *
+ * @return the length of the whole output, which
+ *  was truncated if not less than size
+ */
+int ksnprintf64(char *buf, int size, const char *fmt, ...);
+int kvsnprintf64(char *buf, int size, const char *fmt, va_list ap);
+
 #endif
@@ -1,7 +1,10 @@
+#define LOG_SUBSYSTEM LOG_TR
+
 #include "tr.h"
 #include "status_operations64.h"
 #include "error64.h"
 #include "video64bit.h"
+#include "log.h"
 
 /**
  * The fourth position in the GDT will be used
@@ -134,35 +137,17 @@ void* xdt_read_address(void *table, short offset)
 void print_current_task_status()
 {
     struct task_descriptor *current = get_current_task();
-    putstr64("RIP = "); puthex64(current->current->RIP);
-    putstr64("  RSP = "); puthex64(current->current->RSP);
-    newline64();
-    putstr64("RBP = "); puthex64(current->gpr.RBP);
-    putstr64("  RFLAGS = "); puthex64(current->current->RFLAGS);
-    newline64();
-
-    putstr64("RAX = "); puthex64(current->gpr.RAX);
-    putstr64("  RBX = "); puthex64(current->gpr.RBX);
-    newline64();
-    putstr64("RCX = "); puthex64(current->gpr.RCX);
-    putstr64("  RDX = "); puthex64(current->gpr.RDX);
-    newline64();
-
-    putstr64("RDI = "); puthex64(current->gpr.RDI);
-    putstr64("  RSI = "); puthex64(current->gpr.RSI);
-    newline64();
+    log_error("RIP = %p  RSP = %p", current->current->RIP, current->current->RSP);
+    log_error("RBP = %p  RFLAGS = %p", current->gpr.RBP, current->current->RFLAGS);
+
+    log_error("RAX = %p  RBX = %p", current->gpr.RAX, current->gpr.RBX);
+    log_error("RCX = %p  RDX = %p", current->gpr.RCX, current->gpr.RDX);
+
+    log_error("RDI = %p  RSI = %p", current->gpr.RDI, current->gpr.RSI);
     /* 8 news */
-    putstr64("R8  = "); puthex64(current->gpr.R8);
-    putstr64("  R9  = "); puthex64(current->gpr.R9);
-    newline64();
-    putstr64("R10 = "); puthex64(current->gpr.R10);
-    putstr64("  R11 = "); puthex64(current->gpr.R11);
-    newline64();
-    putstr64("R12 = "); puthex64(current->gpr.R12);
-    putstr64("  R13 = "); puthex64(current->gpr.R13);
-    newline64();
-    putstr64("R14 = "); puthex64(current->gpr.R14);
-    putstr64("  R15 = "); puthex64(current->gpr.R15);
-    newline64();
+    log_error("R8  = %p  R9  = %p", current->gpr.R8, current->gpr.R9);
+    log_error("R10 = %p  R11 = %p", current->gpr.R10, current->gpr.R11);
+    log_error("R12 = %p  R13 = %p", current->gpr.R12, current->gpr.R13);
+    log_error("R14 = %p  R15 = %p", current->gpr.R14, current->gpr.R15);
 
 }
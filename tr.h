@@ -151,6 +151,7 @@ struct task_descriptor
 
     struct CRegisters
     {
+        /* With CR4.PCIDE set bits 11:0 hold the PCID, see vmm.h */
         long cr3;
     } __attribute__ ((packed)) cr;
 
@@ -9,6 +9,9 @@
 #include "video64bit.h"
 #include "io64.h"
 #include "string64.h"
+#include "vmm.h"
+#include "serial64.h"
+#include "fbcon.h"
 
 #define TEXT_ROWS 25
 #define TEXT_COLS 80
@@ -21,12 +24,72 @@ static int BACKGROUND_COLOR = (1 << 12);
  * Memory location on video memory on x86 at startup.
  */
 #define VIDEO_MEMORY 0xB8000
+/* Up to 0xBFFFF, 8 pages of text */
+#define VIDEO_MEMORY_SIZE 0x8000
 typedef short int video_array[TEXT_ROWS][TEXT_COLS];
-static video_array * const video_memory = (video_array * const)VIDEO_MEMORY;
+typedef short int video_row[TEXT_COLS];
+static video_row * const video_memory = (video_row * const)VIDEO_MEMORY;
+
+/**
+ * Rows of text held by video memory (204). The CRTC
+ * start address selects the first row displayed, so
+ * scrolling moves it by one row instead of copying
+ * the whole screen. Once the window reaches the end
+ * the screen is copied back to row 0.
+ */
+#define VIDEO_ROWS (VIDEO_MEMORY_SIZE / sizeof(video_row))
+#define ALL_ROWS ((1U << TEXT_ROWS) - 1)
+
+/**
+ * Rows scrolled off the screen kept in RAM,
+ * see scrollback64. 0 disables the scrollback.
+ */
+#define SCROLLBACK_ROWS 256
 
 /* Current position of the cursor */
 static int col, row;
 
+/**
+ * Characters are written to a copy of the screen
+ * in RAM. Rows changed since the last flush are
+ * then copied to video memory whole, and the
+ * hardware cursor (4 port writes) is moved once.
+ *
+ * The copy is a ring of rows starting at "first",
+ * so that scrolling does not move it either.
+ */
+static video_array shadow __attribute__ ((aligned (8)));
+static int first;
+/* Bit n set when row n of the screen must be copied */
+static unsigned int dirty_rows;
+/* Row of video memory displayed first */
+static int top;
+/* Values last given to the CRTC, -1 if unknown */
+static int shown_top = -1, cursor_position = -1;
+/* Nesting of functions writing many characters */
+static int batch;
+
+/**
+ * Characters are also sent to the serial console,
+ * except the spaces newline64 pads rows with.
+ */
+static int serial_output = 1;
+static int padding;
+
+/**
+ * Set when the bootloader left a graphics mode:
+ * text goes to fbcon.c instead of video memory.
+ */
+static int framebuffer_console;
+
+#if SCROLLBACK_ROWS
+static video_row scrollback[SCROLLBACK_ROWS] __attribute__ ((aligned (8)));
+/* Next row of scrollback to write, rows saved */
+static int scrollback_next, scrollback_count;
+/* Rows the screen is scrolled back, 0 for live output */
+static int view_offset;
+#endif
+
 static inline void next_position(int *row, int *col)
 {
     if (!row || !col)
@@ -46,26 +109,216 @@ static inline void next_position(int *row, int *col)
     }
 }
 
-void clear_screen64()
+void video_init64()
+{
+    /**
+     * The MTRRs usually make the legacy video range
+     * uncacheable: every character is a separate bus
+     * transaction. With a write combining PAT entry
+     * the writes of a line or of a clear are sent as
+     * bursts. The buffers are drained by the I/O
+     * instructions moving the cursor, so what is
+     * written becomes visible as before.
+     * On failure the identity mapping is unchanged.
+     */
+    vmm_map((void *)VIDEO_MEMORY, VIDEO_MEMORY, VIDEO_MEMORY_SIZE,
+        VMM_WRITE | VMM_WRITE_COMBINING);
+    framebuffer_console = !fbcon_init64();
+}
+
+/**
+ * Column of the cursor on the console in use
+ */
+static inline int cursor_column()
+{
+    return framebuffer_console ? fbcon_column64() : col;
+}
+
+/**
+ * Row r of the screen in the shadow copy
+ */
+static inline short *shadow_row(int r)
+{
+    return shadow[(first + r) % TEXT_ROWS];
+}
+
+/**
+ * Copy a row 8 bytes at a time, 160 bytes
+ * are a few write combining bursts.
+ */
+static void copy_row(short *dst, const short *src)
 {
+    const unsigned long *s = (const unsigned long *)src;
+    unsigned long *d = (unsigned long *)dst;
     int i;
-    col = 0; row = 0;
-    for (i = 0; i != TEXT_ROWS * TEXT_COLS; ++i)
+
+    for (i = 0; i != TEXT_COLS * sizeof(short) / sizeof(long); ++i)
     {
-        putc64('\0');
+        d[i] = s[i];
     }
+}
+
+static void clear_row(short *dst)
+{
+    int i;
+    for (i = 0; i != TEXT_COLS; ++i)
+    {
+        dst[i] = FOREGROUND_COLOR | BACKGROUND_COLOR;
+    }
+}
+
+/**
+ * See "Start Address High Register (Index 0Ch)" and
+ * "Start Address Low Register (Index 0Dh)"
+ *  http://www.osdever.net/FreeVGA/vga/crtcreg.htm#0C
+ */
+static void set_start_address(unsigned short position)
+{
+    outputb64(0x3D4, 0x0C);
+    outputb64(0x3D5, (unsigned char)(position >> 8) & 0xff);
+
+    outputb64(0x3D4, 0x0D);
+    outputb64(0x3D5, (unsigned char)position & 0xff);
+}
+
+/**
+ * Move the screen one row up, the last
+ * row becomes empty.
+ */
+static void scroll()
+{
+#if SCROLLBACK_ROWS
+    copy_row(scrollback[scrollback_next], shadow_row(0));
+    scrollback_next = (scrollback_next + 1) % SCROLLBACK_ROWS;
+    if (scrollback_count != SCROLLBACK_ROWS)
+        ++scrollback_count;
+#endif
+    first = (first + 1) % TEXT_ROWS;
+    clear_row(shadow_row(TEXT_ROWS - 1));
+    /* Rows keep their place in video memory */
+    dirty_rows = (dirty_rows >> 1) | (1U << (TEXT_ROWS - 1));
+    if (++top + TEXT_ROWS > VIDEO_ROWS)
+    {
+        top = 0;
+        dirty_rows = ALL_ROWS;
+    }
+}
+
+void video_flush64()
+{
+    int r, position;
+
+    if (framebuffer_console)
+    {
+        fbcon_flush64();
+        serial_kick64();
+        return;
+    }
+#if SCROLLBACK_ROWS
+    /* New output goes back to the live screen */
+    if (view_offset)
+    {
+        view_offset = 0;
+        dirty_rows = ALL_ROWS;
+    }
+#endif
+    for (r = 0; dirty_rows; ++r)
+    {
+        if (dirty_rows & (1U << r))
+        {
+            copy_row(video_memory[top + r], shadow_row(r));
+            dirty_rows &= ~(1U << r);
+        }
+    }
+    /* Rows are ready before they are displayed */
+    if (top != shown_top)
+    {
+        set_start_address(top * TEXT_COLS);
+        shown_top = top;
+    }
+    position = (top + row) * TEXT_COLS + col;
+    if (position != cursor_position)
+    {
+        move_cursor64(row, col);
+        cursor_position = position;
+    }
+    serial_kick64();
+}
+
+void scrollback64(int rows)
+{
+#if SCROLLBACK_ROWS
+    int r;
+
+    /* Only the rows of video memory are kept */
+    if (framebuffer_console)
+        rows = 0;
+    if (rows > scrollback_count)
+        rows = scrollback_count;
+    if (rows <= 0)
+    {
+        video_flush64();
+        return;
+    }
+    for (r = 0; r != TEXT_ROWS; ++r)
+    {
+        const int line = r - rows;
+        const short *src = line < 0
+            ? scrollback[(scrollback_next + line + SCROLLBACK_ROWS) % SCROLLBACK_ROWS]
+            : shadow_row(line);
+        copy_row(video_memory[top + r], src);
+    }
+    view_offset = rows;
+#else
+    (void)rows;
+#endif
+}
+
+void clear_screen64()
+{
+    int r;
+
+    if (framebuffer_console)
+    {
+        fbcon_clear64(FOREGROUND_COLOR | BACKGROUND_COLOR);
+        video_flush64();
+        return;
+    }
+    for (r = 0; r != TEXT_ROWS; ++r)
+    {
+        clear_row(shadow_row(r));
+    }
+    dirty_rows = ALL_ROWS;
     col = 0; row = 0;
+    video_flush64();
 }
 
 void putc64(char c)
 {
-    (*video_memory)[row][col++] = FOREGROUND_COLOR | BACKGROUND_COLOR | c;
+    if (framebuffer_console)
+    {
+        fbcon_putc64(c, FOREGROUND_COLOR | BACKGROUND_COLOR);
+        if (serial_output)
+            serial_putc64(c);
+        if (!batch)
+            video_flush64();
+        return;
+    }
+    shadow_row(row)[col++] = FOREGROUND_COLOR | BACKGROUND_COLOR | c;
+    dirty_rows |= 1U << row;
+    if (serial_output && !padding)
+        serial_putc64(c);
     if (col == TEXT_COLS)
     {
         col = 0;
-        row = (row+1) % TEXT_ROWS;
+        if (++row == TEXT_ROWS)
+        {
+            scroll();
+            --row;
+        }
     }
-    move_cursor64(row, col);
+    if (!batch)
+        video_flush64();
 }
 
 void puti64(int n)
@@ -98,8 +351,12 @@ void putstr64(const char *str)
     if (!str)
         return;
 
+    ++batch;
     while (*str != 0)
         putc64(*(str++));
+    --batch;
+    if (!batch)
+        video_flush64();
 }
 
 void printline64(const char *str)
@@ -107,18 +364,67 @@ void printline64(const char *str)
     if (!str)
         return;
 
+    ++batch;
     while (*str != 0)
         putc64(*(str++));
     
-    if (col != 0)
+    if (cursor_column() != 0)
         newline64();
+    --batch;
+    if (!batch)
+        video_flush64();
+}
+
+int kprintf64(const char *fmt, ...)
+{
+    char buffer[KPRINTF64_BUFFER_SIZE];
+    va_list ap;
+    int len, i;
+
+    va_start(ap, fmt);
+    len = kvsnprintf64(buffer, sizeof(buffer), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return len;
+    if (len >= sizeof(buffer))
+        len = sizeof(buffer) - 1;
+
+    ++batch;
+    for (i = 0; i != len; ++i)
+    {
+        if (buffer[i] == '\n')
+            newline64();
+        else
+            putc64(buffer[i]);
+    }
+    --batch;
+    if (!batch)
+        video_flush64();
+    return len;
 }
 
 void newline64()
 {
+    if (framebuffer_console)
+    {
+        fbcon_newline64(FOREGROUND_COLOR | BACKGROUND_COLOR);
+        if (serial_output)
+            serial_putc64('\n');
+        if (!batch)
+            video_flush64();
+        return;
+    }
+    ++batch;
+    ++padding;
     do {
         putc64(' ');
     } while (col != 0);
+    --padding;
+    if (serial_output)
+        serial_putc64('\n');
+    --batch;
+    if (!batch)
+        video_flush64();
 }
 
 void disable_cursor64()
@@ -159,7 +465,8 @@ void enable_cursor64()
  */
 void move_cursor64(int row, int col)
 {
-    unsigned short position = (unsigned short) row*TEXT_COLS + col;
+    /* Relative to the start of video memory */
+    unsigned short position = (unsigned short) (top + row)*TEXT_COLS + col;
 
     /* Check console boundaries */
     if (!(0 <= col && col < TEXT_COLS) || !(0 <= row && row < TEXT_ROWS))
@@ -174,6 +481,13 @@ void move_cursor64(int row, int col)
 	outputb64(0x3D5, (unsigned char)(position >> 8) & 0xff);
 }
 
+int set_serial_output64(int enabled)
+{
+    int old = serial_output;
+    serial_output = enabled;
+    return old;
+}
+
 int get_foreground_color()
 {
     return FOREGROUND_COLOR >> 8;
@@ -194,6 +508,6 @@ int get_background_color(void)
 int set_background_color(int bc)
 {
     int old = get_background_color();
-    BACKGROUND_COLOR = (bc & 7) << 8;
+    BACKGROUND_COLOR = (bc & 7) << 12;
     return old;
 }
@@ -1,12 +1,33 @@
 #ifndef VIDE64BIT
 #define VIDE64BIT
 
+/**
+ * @brief map the video memory write combining,
+ * once page tables can be changed (vmm_init)
+ */
+void video_init64();
+
 /**
  * @brief clear console
  * 
  */
 void clear_screen64();
 
+/**
+ * @brief copy the rows changed to video memory
+ * and move the cursor. Called by the functions
+ * below at the end of what they print.
+ */
+void video_flush64();
+
+/**
+ * @brief show the screen as it was the given
+ * number of rows of output ago, as far as the
+ * scrollback allows. Output, a flush or 0 go
+ * back to the live screen.
+ */
+void scrollback64(int rows);
+
 void putc64(char c);
 void puti64(int n);
 void putu64(unsigned n);
@@ -15,10 +36,28 @@ void putlu64(unsigned long n);
 void puthex64(unsigned long n);
 void putstr64(const char *str);
 void printline64(const char *str);
+
+/**
+ * @brief print a formatted string, see ksnprintf64.
+ * '\n' ends the line. The text is formatted on
+ * the stack, up to KPRINTF64_BUFFER_SIZE - 1 bytes,
+ * and written with a single flush.
+ *
+ * @return the number of characters printed
+ */
+#define KPRINTF64_BUFFER_SIZE 256
+int kprintf64(const char *fmt, ...);
 void newline64();
 void disable_cursor64();
 void enable_cursor64();
 void move_cursor64(int row, int col);
+/**
+ * @brief also send what is printed to the serial
+ * console (default), see serial64.h
+ *
+ * @return the previous setting
+ */
+int set_serial_output64(int enabled);
 int get_foreground_color();
 int set_foreground_color(int fc);
 int get_background_color();
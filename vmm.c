@@ -0,0 +1,563 @@
+#include "vmm.h"
+#include "memory.h"
+#include "bitmap64.h"
+#include "msr.h"
+#include "spinlock.h"
+#include "status_operations64.h"
+#include "string64.h"
+
+/**
+ * Bits of paging structure entries, see Intel Manual Vol. 3
+ *  [Table 4-15. Format of a PML4 Entry (PML4E)...] and following
+ */
+#define PTE_PRESENT     (1UL << 0)
+#define PTE_WRITE       (1UL << 1)
+#define PTE_USER        (1UL << 2)
+#define PTE_PWT         (1UL << 3)
+#define PTE_PCD         (1UL << 4)
+/* Set in PDPTEs and PDEs mapping 1GB and 2MB pages */
+#define PTE_PS          (1UL << 7)
+/* PAT is bit 7 in PTEs, bit 12 in entries of big pages */
+#define PTE_PAT_4KB     (1UL << 7)
+#define PTE_PAT_BIG     (1UL << 12)
+#define PTE_GLOBAL      (1UL << 8)
+#define PTE_NX          (1UL << 63)
+#define PTE_ADDRESS     0x000ffffffffff000UL
+
+/**
+ * Non leaf entries grant everything,
+ * the leaf decides.
+ */
+#define PTE_TABLE (PTE_PRESENT | PTE_WRITE | PTE_USER)
+
+#define ENTRIES 512
+
+/**
+ * IA32_EFER.NXE, execute disable bit enabled
+ */
+#define EFER_NXE (1UL << 11)
+
+/**
+ * See Intel Manual Vol. 3
+ *  [4.10.1 Process-Context Identifiers (PCIDs)]
+ */
+#define CR4_PCIDE       (1UL << 17)
+#define CPUID_1_ECX_PCID (1 << 17)
+#define PCID_COUNT      4096
+#define CR3_PCID        (PCID_COUNT - 1UL)
+#define CR3_NOFLUSH     (1UL << 63)
+
+#define CR4_PGE         (1UL << 7)
+
+/**
+ * Memory type of PAT entry 4, see Intel Manual Vol. 3
+ *  [Table 13-10. Memory Types That Can Be Encoded With PAT]
+ */
+#define PAT_ENTRY_4_SHIFT   32
+#define PAT_WRITE_COMBINING 0x01UL
+/* CPUID.(EAX=07H,ECX=0):EBX.INVPCID[bit 10] */
+#define CPUID_7_EBX_INVPCID (1 << 10)
+
+/**
+ * INVPCID types, see Intel Manual Vol. 2
+ *  [INVPCID—Invalidate Process-Context Identifier]
+ */
+#define INVPCID_SINGLE_CONTEXT  1
+#define INVPCID_ALL_GLOBAL      2
+
+struct invpcid_descriptor
+{
+    unsigned long pcid;
+    unsigned long address;
+};
+
+void vmm_invpcid(unsigned long type, struct invpcid_descriptor *descriptor);
+
+/**
+ * Tables are identified by level:
+ *  3 PML4, 2 PDPT, 1 page directory, 0 page table.
+ * A leaf at level n maps level_size(n) bytes.
+ */
+static inline unsigned long level_shift(int level)
+{
+    return 12 + 9 * level;
+}
+
+static inline unsigned long level_size(int level)
+{
+    return 1UL << level_shift(level);
+}
+
+static inline int level_index(unsigned long va, int level)
+{
+    return (va >> level_shift(level)) & (ENTRIES - 1);
+}
+
+static inline unsigned long leaf_address(unsigned long entry, int level)
+{
+    return entry & PTE_ADDRESS & ~(level_size(level) - 1);
+}
+
+static inline int is_leaf(unsigned long entry, int level)
+{
+    return !level || (level < 3 && (entry & PTE_PS));
+}
+
+static inline unsigned long *table_of(unsigned long entry)
+{
+    return (unsigned long *)(entry & PTE_ADDRESS);
+}
+
+/* Highest level of leaves: 2 with 1GB pages, 1 otherwise */
+static int max_leaf_level = 1;
+static unsigned long nx_bit;
+static spinlock_t vmm_lock = SPINLOCK_INIT;
+
+static int pcid_enabled;
+static struct vmm_space kernel_space;
+
+/**
+ * PCIDs in use, PCID 0 belongs to the kernel
+ */
+static struct bitmap64 pcids;
+static unsigned long pcid_words[BITMAP64_WORDS(PCID_COUNT)];
+static unsigned long pcid_summary[BITMAP64_SUMMARY_WORDS(PCID_COUNT)];
+
+/**
+ * Incremented when a present translation is changed
+ * or removed. INVLPG only invalidates the current
+ * PCID, the others are flushed when next used.
+ */
+static unsigned long tlb_generation = 1;
+
+/**
+ * INVLPG keeps the PCID of the active space
+ * up to date, only the others become stale.
+ */
+static struct vmm_space *active_space = &kernel_space;
+
+static void tlb_changed()
+{
+    ++tlb_generation;
+    active_space->generation = tlb_generation;
+}
+
+static int invpcid_supported;
+static struct tlb_gather gathers[MAX_CPUS];
+static void (*tlb_shootdown)(struct tlb_gather *g);
+
+/**
+ * Record that the translation of the leaf
+ * mapping va (entry "old") was changed.
+ */
+static void tlb_gather_add(unsigned long va, unsigned long old)
+{
+    struct tlb_gather *g = &gathers[smp_processor_id()];
+
+    if (old & PTE_GLOBAL)
+        g->global = 1;
+    if (g->count == TLB_GATHER_MAX)
+        g->overflow = 1;
+    else
+        g->addresses[g->count++] = va;
+}
+
+static void tlb_flush_all(int global)
+{
+    struct invpcid_descriptor d = { 0, 0 };
+    unsigned long cr4;
+
+    if (invpcid_supported)
+    {
+        d.pcid = so_read_cr3() & CR3_PCID;
+        vmm_invpcid(global ? INVPCID_ALL_GLOBAL : INVPCID_SINGLE_CONTEXT, &d);
+        return;
+    }
+    cr4 = so_read_cr4();
+    if (global && (cr4 & CR4_PGE))
+    {
+        /* Changing CR4.PGE flushes every PCID */
+        vmm_write_cr4(cr4 & ~CR4_PGE);
+        vmm_write_cr4(cr4);
+        return;
+    }
+    /* Bit 63 is read as 0: the current PCID is flushed */
+    vmm_write_cr3(so_read_cr3());
+}
+
+static void tlb_gather_flush(struct tlb_gather *g)
+{
+    int i;
+
+    if (!g->count)
+        return;
+    if (g->overflow)
+        tlb_flush_all(g->global);
+    else
+    {
+        for (i = 0; i != g->count; ++i)
+            vmm_invlpg((void *)g->addresses[i]);
+    }
+    tlb_changed();
+    if (tlb_shootdown)
+        tlb_shootdown(g);
+    g->count = 0;
+    g->overflow = 0;
+    g->global = 0;
+}
+
+void vmm_batch_begin()
+{
+    ++gathers[smp_processor_id()].depth;
+}
+
+void vmm_batch_end()
+{
+    struct tlb_gather *g = &gathers[smp_processor_id()];
+
+    if (!--g->depth)
+        tlb_gather_flush(g);
+}
+
+void vmm_set_shootdown(void (*shootdown)(struct tlb_gather *g))
+{
+    tlb_shootdown = shootdown;
+}
+
+void vmm_init()
+{
+    unsigned int regs[4];
+
+    /* CPUID.80000001H:EDX.Page1GB[bit 26] */
+    so_cpuid(0x80000001, 0, regs);
+    if (regs[3] & (1 << 26))
+        max_leaf_level = 2;
+    /* Without NXE bit 63 is reserved */
+    if (msr_read_ia32_efer() & EFER_NXE)
+        nx_bit = PTE_NX;
+
+    /**
+     * Every processor supporting long mode has a PAT.
+     * No mapping sets the PAT bit yet, so entry 4 can
+     * change without flushing caches and TLBs.
+     */
+    msr_write_ia32_pat((msr_read_ia32_pat() & ~(0xffUL << PAT_ENTRY_4_SHIFT))
+        | (PAT_WRITE_COMBINING << PAT_ENTRY_4_SHIFT));
+
+    kernel_space.pml4 = so_read_cr3() & PTE_ADDRESS;
+    kernel_space.pcid = 0;
+    kernel_space.generation = tlb_generation;
+    bitmap64_init(&pcids, pcid_words, pcid_summary, PCID_COUNT);
+    bitmap64_set(&pcids, 0);
+
+    /**
+     * CR4.PCIDE can be set only if CR3[11:0] is 0,
+     * true for the boot PML4 (PCID 0).
+     */
+    so_cpuid(1, 0, regs);
+    if (regs[2] & CPUID_1_ECX_PCID)
+    {
+        vmm_write_cr4(so_read_cr4() | CR4_PCIDE);
+        pcid_enabled = 1;
+    }
+    so_cpuid(0, 0, regs);
+    if (regs[0] >= 7)
+    {
+        so_cpuid(7, 0, regs);
+        invpcid_supported = !!(regs[1] & CPUID_7_EBX_INVPCID);
+    }
+}
+
+int vmm_pcid_enabled()
+{
+    return pcid_enabled;
+}
+
+struct vmm_space *vmm_kernel_space()
+{
+    return &kernel_space;
+}
+
+int vmm_space_create(struct vmm_space *s)
+{
+    unsigned long *pml4 = kalloc_page();
+    long pcid = -1;
+
+    if (!pml4)
+        return 1;
+    /* Every entry is written, no need to clear it first */
+    memcpy64(pml4, (void *)kernel_space.pml4, ENTRIES * sizeof(*pml4));
+
+    spin_lock(&vmm_lock);
+    if (pcid_enabled)
+        pcid = bitmap64_alloc(&pcids);
+    spin_unlock(&vmm_lock);
+
+    s->pml4 = (unsigned long)pml4;
+    /* Out of PCIDs, flush on every switch */
+    s->pcid = pcid < 0 ? 0 : pcid;
+    /* The PCID may hold entries of a destroyed space */
+    s->generation = 0;
+    return 0;
+}
+
+void vmm_space_destroy(struct vmm_space *s)
+{
+    if ((so_read_cr3() & PTE_ADDRESS) == s->pml4)
+        vmm_switch(&kernel_space);
+    spin_lock(&vmm_lock);
+    if (s->pcid)
+        bitmap64_clear(&pcids, s->pcid);
+    spin_unlock(&vmm_lock);
+    kfree_page((void *)s->pml4);
+    s->pml4 = 0;
+    s->pcid = 0;
+}
+
+void vmm_switch(struct vmm_space *s)
+{
+    unsigned long cr3 = s->pml4;
+
+    /* Pending invalidations belong to the old PCID */
+    tlb_gather_flush(&gathers[smp_processor_id()]);
+    active_space = s;
+    if (!pcid_enabled)
+    {
+        vmm_write_cr3(cr3);
+        return;
+    }
+    /**
+     * Untagged spaces use PCID 0 too: their entries
+     * must not survive in the kernel address space.
+     */
+    if (s != &kernel_space && !s->pcid)
+    {
+        kernel_space.generation = 0;
+        vmm_write_cr3(cr3);
+        return;
+    }
+    cr3 |= s->pcid;
+    if (s->generation == tlb_generation)
+        cr3 |= CR3_NOFLUSH;
+    s->generation = tlb_generation;
+    vmm_write_cr3(cr3);
+}
+
+/**
+ * Entry of a leaf at the given level from VMM_* flags
+ */
+static unsigned long leaf_bits(unsigned long flags, int level)
+{
+    unsigned long e = PTE_PRESENT;
+    if (flags & VMM_WRITE)
+        e |= PTE_WRITE;
+    if (flags & VMM_USER)
+        e |= PTE_USER;
+    if (flags & VMM_WRITE_THROUGH)
+        e |= PTE_PWT;
+    if (flags & VMM_CACHE_DISABLE)
+        e |= PTE_PCD;
+    if (flags & VMM_GLOBAL)
+        e |= PTE_GLOBAL;
+    if (flags & VMM_PAT)
+        e |= level ? PTE_PAT_BIG : PTE_PAT_4KB;
+    if (flags & VMM_NO_EXECUTE)
+        e |= nx_bit;
+    if (level)
+        e |= PTE_PS;
+    return e;
+}
+
+/**
+ * Replace a big page with a table of 512 smaller
+ * pages with the same translation and attributes.
+ */
+static int split_leaf(unsigned long *entry, int level)
+{
+    unsigned long *table = kalloc_page_zeroed();
+    const unsigned long pa = leaf_address(*entry, level);
+    unsigned long bits = *entry & (PTE_PRESENT | PTE_WRITE | PTE_USER | PTE_PWT
+        | PTE_PCD | PTE_GLOBAL | PTE_NX);
+    int i;
+
+    if (!table)
+        return 1;
+    if (*entry & PTE_PAT_BIG)
+        bits |= level - 1 ? PTE_PAT_BIG : PTE_PAT_4KB;
+    if (level - 1)
+        bits |= PTE_PS;
+    for (i = 0; i != ENTRIES; ++i)
+    {
+        table[i] = (pa + i * level_size(level - 1)) | bits;
+    }
+    *entry = (unsigned long)table | PTE_TABLE;
+    return 0;
+}
+
+/**
+ * Return the entry for va in the table of the given
+ * level, creating missing tables and splitting big
+ * pages on the way. Null if out of memory.
+ */
+static unsigned long *walk_create(unsigned long va, int level)
+{
+    unsigned long *table = (unsigned long *)(so_read_cr3() & PTE_ADDRESS);
+    int l;
+
+    for (l = 3; l != level; --l)
+    {
+        unsigned long *e = &table[level_index(va, l)];
+        if (!(*e & PTE_PRESENT))
+        {
+            unsigned long *t = kalloc_page_zeroed();
+            if (!t)
+                return (void*)0;
+            *e = (unsigned long)t | PTE_TABLE;
+        }
+        else if (is_leaf(*e, l) && split_leaf(e, l))
+        {
+            return (void*)0;
+        }
+        table = table_of(*e);
+    }
+    return &table[level_index(va, level)];
+}
+
+/**
+ * Return the entry where the translation of va ends:
+ * a leaf or a non present entry, and its level.
+ */
+static unsigned long *walk_find(unsigned long va, int *level)
+{
+    unsigned long *table = (unsigned long *)(so_read_cr3() & PTE_ADDRESS);
+    int l;
+
+    for (l = 3; ; --l)
+    {
+        unsigned long *e = &table[level_index(va, l)];
+        if (!(*e & PTE_PRESENT) || is_leaf(*e, l))
+        {
+            *level = l;
+            return e;
+        }
+        table = table_of(*e);
+    }
+}
+
+static int page_aligned(unsigned long x)
+{
+    return !(x & (VMM_PAGE_SIZE - 1));
+}
+
+int vmm_map(void *va, unsigned long pa, unsigned long size, unsigned long flags)
+{
+    unsigned long v = (unsigned long)va;
+
+    if (!page_aligned(v) || !page_aligned(pa) || !page_aligned(size))
+        return 1;
+
+    vmm_batch_begin();
+    spin_lock(&vmm_lock);
+    while (size)
+    {
+        unsigned long *e, old;
+        int level = max_leaf_level;
+
+        /* Biggest page allowed by alignment and size */
+        while (level && (((v | pa) & (level_size(level) - 1)) || size < level_size(level)))
+            --level;
+        /* Keep existing tables, use smaller pages inside them */
+        for (;;)
+        {
+            e = walk_create(v, level);
+            if (!e)
+            {
+                spin_unlock(&vmm_lock);
+                vmm_batch_end();
+                return 1;
+            }
+            if (!level || !(*e & PTE_PRESENT) || (*e & PTE_PS))
+                break;
+            --level;
+        }
+
+        old = *e;
+        *e = pa | leaf_bits(flags, level);
+        if (old & PTE_PRESENT)
+            tlb_gather_add(v, old);
+
+        v += level_size(level);
+        pa += level_size(level);
+        size -= level_size(level);
+    }
+    spin_unlock(&vmm_lock);
+    vmm_batch_end();
+    return 0;
+}
+
+/**
+ * Unmap or change the flags of [va, va + size),
+ * splitting big pages crossing the boundaries.
+ */
+static int vmm_update(unsigned long va, unsigned long size, int unmap, unsigned long flags)
+{
+    const unsigned long end = va + size;
+
+    if (!page_aligned(va) || !page_aligned(size))
+        return 1;
+
+    vmm_batch_begin();
+    spin_lock(&vmm_lock);
+    while (va < end)
+    {
+        int level;
+        unsigned long *e = walk_find(va, &level);
+        const unsigned long next = (va | (level_size(level) - 1)) + 1;
+
+        if (!(*e & PTE_PRESENT))
+        {
+            va = next;
+            continue;
+        }
+        /* Only part of a big page is involved */
+        if ((va & (level_size(level) - 1)) || next > end)
+        {
+            if (split_leaf(e, level))
+            {
+                spin_unlock(&vmm_lock);
+                vmm_batch_end();
+                return 1;
+            }
+            continue;
+        }
+        tlb_gather_add(va, *e);
+        if (unmap)
+            *e = 0;
+        else
+            *e = leaf_address(*e, level) | leaf_bits(flags, level);
+        va = next;
+    }
+    spin_unlock(&vmm_lock);
+    vmm_batch_end();
+    return 0;
+}
+
+int vmm_unmap(void *va, unsigned long size)
+{
+    return vmm_update((unsigned long)va, size, 1, 0);
+}
+
+int vmm_protect(void *va, unsigned long size, unsigned long flags)
+{
+    return vmm_update((unsigned long)va, size, 0, flags);
+}
+
+unsigned long vmm_translate(void *va)
+{
+    int level;
+    unsigned long *e = walk_find((unsigned long)va, &level);
+
+    if (!(*e & PTE_PRESENT))
+        return -1UL;
+    return leaf_address(*e, level) | ((unsigned long)va & (level_size(level) - 1));
+}
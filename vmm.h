@@ -0,0 +1,186 @@
+/**
+ * Management of the 4 level page tables of the
+ * running kernel (the ones referenced by CR3).
+ *
+ * Mappings are created with the biggest pages
+ * allowed by the alignment of the virtual and
+ * physical addresses: 1GB (if supported), 2MB
+ * or 4KB. Big pages are split when only part
+ * of them is unmapped or protected.
+ *
+ * Page tables are taken from kalloc_page and
+ * accessed through the identity mapping.
+ *
+ * See Intel Manual Vol. 3
+ *  [4.5 4-LEVEL PAGING AND 5-LEVEL PAGING]
+ */
+
+#ifndef VMM
+#define VMM
+
+#include "smp.h"
+
+#define VMM_PAGE_SIZE 4096UL
+
+/**
+ * Flags of a mapping. Pages are always present
+ * and readable.
+ */
+#define VMM_WRITE           (1UL << 0)
+#define VMM_USER            (1UL << 1)
+#define VMM_WRITE_THROUGH   (1UL << 2)
+#define VMM_CACHE_DISABLE   (1UL << 3)
+/* Selects the upper half of the PAT, see msr.h */
+#define VMM_PAT             (1UL << 4)
+#define VMM_GLOBAL          (1UL << 5)
+/* Ignored if IA32_EFER.NXE is clear */
+#define VMM_NO_EXECUTE      (1UL << 6)
+
+/**
+ * vmm_init programs PAT entry 4 (PAT=1, PCD=0,
+ * PWT=0) as write combining: stores are merged
+ * in buffers and written as bursts, for frame
+ * buffers. Entries 0-3 keep the reset values.
+ */
+#define VMM_WRITE_COMBINING VMM_PAT
+
+/**
+ * Detect the supported page sizes, to be
+ * called once before any other function.
+ */
+void vmm_init();
+
+/**
+ * Map [va, va + size) to [pa, pa + size), replacing
+ * existing mappings. Addresses and size must be
+ * multiples of VMM_PAGE_SIZE.
+ *
+ * Return 0 on success, nonzero otherwise. On failure
+ * part of the range may be mapped.
+ */
+int vmm_map(void *va, unsigned long pa, unsigned long size, unsigned long flags);
+
+/**
+ * Remove the mappings in [va, va + size).
+ * Unmapped pages in the range are ignored.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int vmm_unmap(void *va, unsigned long size);
+
+/**
+ * Change the flags of the mappings in [va, va + size).
+ * Unmapped pages in the range are ignored.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int vmm_protect(void *va, unsigned long size, unsigned long flags);
+
+/**
+ * Return the physical address va is mapped to,
+ * or -1 if it is not mapped.
+ */
+unsigned long vmm_translate(void *va);
+
+/**
+ * Invalidate the TLB entries of the page
+ * containing va (INVLPG).
+ */
+void vmm_invlpg(void *va);
+
+/**
+ * Invalidations requested by vmm_map, vmm_unmap
+ * and vmm_protect are collected per processor and
+ * done together at the end of the call, or of the
+ * outermost vmm_batch_begin/vmm_batch_end pair:
+ *  -up to TLB_GATHER_MAX pages, one INVLPG each
+ *  -more, one INVPCID of the current PCID (or of
+ *   all of them if global pages changed), or a
+ *   CR3/CR4.PGE reload without INVPCID.
+ *
+ * Frames unmapped inside a batch must not be
+ * reused before vmm_batch_end returns.
+ */
+#define TLB_GATHER_MAX 32
+
+struct tlb_gather
+{
+    unsigned long addresses[TLB_GATHER_MAX];
+    int count;
+    /* More than TLB_GATHER_MAX pages, flush everything */
+    int overflow;
+    /* A global translation was changed */
+    int global;
+    /* Nesting of vmm_batch_begin */
+    int depth;
+} __attribute__ ((aligned (CACHE_LINE_SIZE)));
+
+void vmm_batch_begin();
+void vmm_batch_end();
+
+/**
+ * Called with every non empty batch after the local
+ * flush, to invalidate the TLBs of the other
+ * processors. None while only the bootstrap
+ * processor runs.
+ */
+void vmm_set_shootdown(void (*shootdown)(struct tlb_gather *g));
+
+/**
+ * Load CR3. Without PCIDs (or with bit 63 clear)
+ * non global TLB entries are flushed.
+ */
+void vmm_write_cr3(unsigned long cr3);
+
+void vmm_write_cr4(unsigned long cr4);
+
+/**
+ * An address space: a PML4 sharing the kernel
+ * mappings and the PCID tagging its TLB entries,
+ * so that switching to it keeps them.
+ *
+ * vmm_map, vmm_unmap and vmm_protect change the
+ * active address space. Tables below the entries
+ * copied from the kernel PML4 are shared.
+ */
+struct vmm_space
+{
+    unsigned long pml4;
+    /* 0 if untagged: switching always flushes */
+    unsigned int pcid;
+    /* TLB generation when the PCID was last flushed */
+    unsigned long generation;
+};
+
+/**
+ * Is CR4.PCIDE set?
+ */
+int vmm_pcid_enabled();
+
+/**
+ * The address space built at boot, PCID 0.
+ */
+struct vmm_space *vmm_kernel_space();
+
+/**
+ * Create an address space with the kernel mappings
+ * and a PCID, if any is left.
+ *
+ * Return 0 on success, nonzero otherwise.
+ */
+int vmm_space_create(struct vmm_space *s);
+
+/**
+ * Release the PML4 and the PCID of an address
+ * space, switching to the kernel one if needed.
+ */
+void vmm_space_destroy(struct vmm_space *s);
+
+/**
+ * Make s the active address space. TLB entries
+ * are kept unless mappings were changed since
+ * the PCID was last flushed.
+ */
+void vmm_switch(struct vmm_space *s);
+
+#endif
@@ -1,6 +1,9 @@
 
+#define LOG_SUBSYSTEM LOG_VMX
+
 #include "vm64.h"
 #include "../video64bit.h"
+#include "../log.h"
 #include "../error64.h"
 
 #include "../tr.h"
@@ -12,12 +15,13 @@
 #include "../status_operations64.h"
 #include "../interrupt/interrupt64.h"
 #include "../memory.h"
+#include "../arena.h"
 
 #define VMsucceed (1<<0 | 1<<2 | 1<<4 | 1<<6 | 1<<7 | 1<<11)
 #define VMfailinvalid (1<<2 | 1<<4 | 1<<6 | 1<<7 | 1<<11)
 
 static void vmx_save_host_state();
-static void vmx_prepare_guest_state();
+static void vmx_prepare_guest_state(void *guest_stack);
 static void vmx_configure_control_fields();
 static void vmx_configure_vmentry_fields();
 static void vmx_configure_vmexit_fields();
@@ -41,14 +45,12 @@ static void test_cr0_and_cr4(unsigned long cr0, unsigned long cr4)
     long test;
     if ((test = vmx_validate_cr0(cr0)))
     {
-        putstr64("CRO BAD: "); puthex64(test); newline64();
-        putstr64("my CRO:  "); puthex64(cr0); newline64();
+        log_error("CRO BAD: %p\nmy CRO:  %p", test, cr0);
         panic64("INVALID CR0");
     }
     if ((test = vmx_validate_cr4(cr4)))
     {
-        putstr64("CR4 BAD: "); puthex64(test); newline64();
-        putstr64("my CR4:  "); puthex64(cr4); newline64();
+        log_error("CR4 BAD: %p\nmy CR4:  %p", test, cr4);
         panic64("INVALID CR4");
     }
     const long CR4_CET = 1L << 23;
@@ -100,58 +102,62 @@ static int vmx_fail_invalid(int status)
     return status == 1;
 }
 
-void vmx_exit(void *vmx_region)
+void vmx_exit()
 {
     int status = vmxoff();
     if (!vmx_success(status))
     {
         panic64("vmxoff");
     }
-    kfree_page(vmx_region);
 }
 
-void dispose_vmcs_region(void *vmcs_region)
-{
-    kfree_page(vmcs_region);
-}
+/**
+ * Size of the stack given to the guest
+ */
+#define VM_GUEST_STACK_SIZE 4096
 
 int start_vm()
 {
     int status;
+    /**
+     * Owns all the memory of the VM: VMXON region,
+     * VMCS and guest stack. It is released at once
+     * by arena_destroy when the VM is done.
+     */
+    struct arena vm_arena;
+    arena_init(&vm_arena);
 
     if (check_vm_support())
     {
-        printline64("VMX supported!");
+        log_info("VMX supported!");
     }
     else
     {
         panic64("VMX not supported!");
     }
-    putstr64("Rev Id = "); putu64(read_vmcs_revision_identifier()); newline64();
-    putstr64("VMX    = "); putl64(read_IA32_VMX_BASIC()); newline64();
+    log_debug("Rev Id = %u\nVMX    = %ld", read_vmcs_revision_identifier(), read_IA32_VMX_BASIC());
     set_cr4_vmxe();
-    printline64("CR4.VMXE set!");
-    void *vmx_region = get_vmx_region();
+    log_debug("CR4.VMXE set!");
+    void *vmx_region = get_vmx_region(&vm_arena);
     if (!vmx_region)
     {
         panic64("get_vmcs_region");
     }
-    putstr64("vmx_region = "); puthex64((unsigned long)vmx_region); newline64();
-    putstr64("vmx_region = "); puti64((unsigned long)vmx_region); newline64();
-    putstr64("*vmx_region = "); puthex64(*(unsigned long*)vmx_region); newline64();
+    log_debug("vmx_region = %p\nvmx_region = %lu\n*vmx_region = %p",
+        vmx_region, (unsigned long)vmx_region, *(unsigned long*)vmx_region);
 
     status = enter_vmx(vmx_region);
     if (!vmx_success(status))
     {
-        printline64("enter_vmx failed!");
+        log_error("enter_vmx failed!");
         if (vmx_fail_invalid(status))
         {
             panic64("vmx_fail_invalid");
         }
     }
 
-    printline64("enter_vmx success");
-    void *vmcs_region = get_vmcs_region();
+    log_info("enter_vmx success");
+    void *vmcs_region = get_vmcs_region(&vm_arena);
     if (!vmcs_region)
     {
         panic64("get_vmcs_region");
@@ -178,43 +184,44 @@ int start_vm()
     {
         panic64("Disaster VMPTRLD");
     }
-    printline64("VMCS region enabled!");
+    log_debug("VMCS region enabled!");
 
     vmx_set_default_controls_values();
 
-    printline64("Saving host state... ");
+    log_debug("Saving host state... ");
     vmx_save_host_state();
-    printline64("DONE!");
+    log_debug("DONE!");
 
-    printline64("Preparing guest state... ");
-    vmx_prepare_guest_state();
-    printline64("DONE!");
+    log_debug("Preparing guest state... ");
+    {
+        char *guest_stack = arena_alloc(&vm_arena, VM_GUEST_STACK_SIZE, 16);
+        if (!guest_stack)
+        {
+            panic64("guest stack");
+        }
+        vmx_prepare_guest_state(guest_stack + VM_GUEST_STACK_SIZE);
+    }
+    log_debug("DONE!");
 
-    putstr64("Configuring VMCS control fields... ");
+    log_debug("Configuring VMCS control fields... ");
     vmx_configure_control_fields();
-    printline64("DONE!");
+    log_debug("DONE!");
 
-    printline64("Launcing VMCS...");
+    log_info("Launcing VMCS...");
     status = vmx_launch_current_vmcs();
-    putstr64("status = "); puti64(status); newline64();
-    putstr64("abort status = "); puti64(vmx_get_vmcs_region_abort_status(vmcs_region)); newline64();
-    putstr64("exit reason = "); puti64(vmx_read_vm_exit_reason()); newline64();
+    log_debug("status = %d\nabort status = %d\nexit reason = %d", status,
+        vmx_get_vmcs_region_abort_status(vmcs_region), vmx_read_vm_exit_reason());
     {
         int er = vmx_read_vm_instruction_error();
-        putstr64("vm error = ");
-        puti64(er);
         if (er)
-        {
-            putstr64(" [");
-            putstr64(vmx_error_reason(er));
-            putstr64("]");
-        }
-        newline64();
+            log_error("vm error = %d [%s]", er, vmx_error_reason(er));
+        else
+            log_debug("vm error = 0");
     }
 
-    dispose_vmcs_region(vmcs_region);
-    vmx_exit(vmx_region);
-    printline64("VMX exited!");
+    vmx_exit();
+    arena_destroy(&vm_arena);
+    log_info("VMX exited!");
     return 0;
 }
 
@@ -397,7 +404,7 @@ static void vmx_save_host_state()
     //vmx_host_write_ia32_pkrs(msr_read_ia32_pkrs());
 }
 
-static void vmx_prepare_guest_state()
+static void vmx_prepare_guest_state(void *guest_stack)
 {
     unsigned short limit;
     void *ptr;
@@ -427,7 +434,7 @@ static void vmx_prepare_guest_state()
 
     /* Set guest RSP and RIP */
     {
-        long rsp = (long)vmx_get_guest_stack();
+        long rsp = (long)guest_stack;
         vmx_guest_write_rsp(rsp);
         long rip = (long)vmx_get_guest_code();
         vmx_guest_write_rip(rip);
@@ -791,7 +798,7 @@ static void vmx_set_default_controls_values()
          *  VM entry will fail if any of these controls are 0
          *  (see Section 25.2.1).
          */
-        printline64("    test = 0");
+        log_debug("    test = 0");
     }
     else
     {
@@ -803,7 +810,7 @@ static void vmx_set_default_controls_values()
          *  VM entry will fail if any of these controls are 0
          *  (see Section 25.2.1).
          */
-        printline64("    test = 1");
+        log_debug("    test = 1");
     }
 }
 
@@ -19,8 +19,9 @@ int enter_vmx(void *vmx_region);
 int vmxoff();
 void set_cr4_vmxe();
 int check_vm_support();
-void *get_vmx_region();
-void *get_vmcs_region();
+struct arena;
+void *get_vmx_region(struct arena *vm_arena);
+void *get_vmcs_region(struct arena *vm_arena);
 void *get_current_vmcs();
 unsigned long read_IA32_VMX_BASIC();
 unsigned int read_vmcs_revision_identifier();
@@ -31,7 +32,6 @@ int vmx_launch_current_vmcs();
 int vmx_resume_current_vmcs();
 int vmx_read_vmcs_field(long *data, long field);
 int vmx_write_vmcs_field(long field, long data);
-void *vmx_get_guest_stack();
 void *vmx_get_guest_code();
 
 /**
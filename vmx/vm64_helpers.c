@@ -1,34 +1,29 @@
+#define LOG_SUBSYSTEM LOG_VMX
+
 #include "vm64_helpers.h"
 #include "../video64bit.h"
 #include "../error64.h"
 #include "vm64_guest.h"
 #include "../msr.h"
 #include "vm64_control.h"
+#include "../log.h"
 
 int test = 0;
 
 void vmx_print_vm_gp_registers(struct vm64_registers* registers)
 {
-    putstr64("RAX = "); puthex64(registers->RAX);
-    putstr64("    RBX = "); puthex64(registers->RBX); newline64();
-    putstr64("RCX = "); puthex64(registers->RCX);
-    putstr64("    RDX = "); puthex64(registers->RDX); newline64();
-
-    putstr64("RSI = "); puthex64(registers->RSI);
-    putstr64("    RDI = "); puthex64(registers->RDI); newline64();
-    putstr64("RBP = "); puthex64(registers->RBP);
-    putstr64("    RSP = "); puthex64(registers->RSP); newline64();
-
-    putstr64("R8  = "); puthex64(registers->R8);
-    putstr64("    R9  = "); puthex64(registers->R9); newline64();
-    putstr64("R10 = "); puthex64(registers->R10);
-    putstr64("    R11 = "); puthex64(registers->R11); newline64();
-    putstr64("R12 = "); puthex64(registers->R12);
-    putstr64("    R13 = "); puthex64(registers->R13); newline64();
-    putstr64("R14 = "); puthex64(registers->R14);
-    putstr64("    R15 = "); puthex64(registers->R15); newline64();
-
-    putstr64("RIP = "); puthex64(registers->RIP); newline64();
+    log_debug("RAX = %p    RBX = %p", registers->RAX, registers->RBX);
+    log_debug("RCX = %p    RDX = %p", registers->RCX, registers->RDX);
+
+    log_debug("RSI = %p    RDI = %p", registers->RSI, registers->RDI);
+    log_debug("RBP = %p    RSP = %p", registers->RBP, registers->RSP);
+
+    log_debug("R8  = %p    R9  = %p", registers->R8, registers->R9);
+    log_debug("R10 = %p    R11 = %p", registers->R10, registers->R11);
+    log_debug("R12 = %p    R13 = %p", registers->R12, registers->R13);
+    log_debug("R14 = %p    R15 = %p", registers->R14, registers->R15);
+
+    log_debug("RIP = %p", registers->RIP);
 }
 
 int vmx_debug_virtual_machine(struct vm64_registers* registers)
@@ -39,7 +34,8 @@ int vmx_debug_virtual_machine(struct vm64_registers* registers)
      */
     int resume = 0;
     //clear_screen64();
-    printline64("***** DEBUGGING VM *****");
+    /* Printed later by klog_drain, not in the exit path */
+    log_record(KLOG_DEBUG, "***** DEBUGGING VM *****");
     if (!registers)
     {
         panic64("No data!");
@@ -52,15 +48,10 @@ int vmx_debug_virtual_machine(struct vm64_registers* registers)
     //  putstr64("    code  = "); puthex64(vmx_get_guest_code()); newline64();
     //  putstr64("    stack = "); puthex64(vmx_get_guest_stack()); newline64();
 //    putstr64("Guest Activity state = "); puti64(vmx_guest_read_activity_state()); newline64();
-    putstr64("RIP = "); puthex64(registers->RIP); putstr64("  ");
     {
         unsigned long r = (unsigned)vmx_read_vm_exit_reason();
-        putstr64("EXIT REASON = ");
-        puthex64(r);
-        putstr64(" [");
-        putstr64(vmx_exit_reason(r));
-        putstr64("]");
-        newline64();
+        log_record(KLOG_DEBUG, "RIP = %p  EXIT REASON = %p [%s]", registers->RIP, r,
+            (unsigned long)vmx_exit_reason(r));
         switch (r)
         {
         case VMX_EXIT_VMCALL:   /* exited for VMCALL? */